@@ -0,0 +1,36 @@
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef DIM3_SOLVER_H
+#define DIM3_SOLVER_H
+
+// The 3x3 board has 9 tiles, numbered 1 to 8 with a 0 for the empty tile.
+#define DIM3_NUM_TILES 9
+// There are 9! = 362,880 permutations of tiles numbered 0 to 8, (only half of
+// which will actually be valid states of the puzzle board).
+#define DIM3_NUM_BOARDS 362880
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Functions defined in dim3_solver.c, part of the library libfifteen.
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Returns the solution graph for 3x3 puzzles which is shared by every caller,
+ * building it on the first call, or returns NULL upon any error in which case
+ * a later call tries again. It is never released. The graph holds for each
+ * board, indexed by its permutation rank, the tile to move next towards the
+ * solved board, or DIM3_NUM_TILES for the solved board itself.
+ */
+const uint8_t *build_dim3_solutions(void);
+
+/*
+ * Starts building the solutions returned by build_dim3_solutions on a thread
+ * of its own, so that they may be ready before they are first needed. A call
+ * of build_dim3_solutions whilst they are being built waits until they are
+ * done. Returns false if the thread could not be started.
+ */
+bool start_dim3_solutions(void);
+
+#endif
@@ -6,61 +6,64 @@
 
 #define DIM4 4
 #define DIM4_NUM_TILES 16
-#define DIM4_HEURISTICS_FILE "dim4_heuristics.bin"
+#define DIM4_PARTITIONS_FILE "dim4_partitions.txt"
 
-// Constants for a 6,6,3 tile pattern database.
-#define NUM_PATTERNS 3
+// A 4x4 board fits in 64 bits using 4 bits for each location, the tile at
+// index i occupying bits 4i to 4i+3. The same packing is used for the inverse
+// of a board, the location of tile t occupying bits 4t to 4t+3.
+#define DIM4_PACK(value, i) ((uint64_t) (value) << (4 * (i)))
+#define DIM4_UNPACK(packed, i) ((int) (((packed) >> (4 * (i))) & 0xF))
 
-/*
- * Visual reference to tiles for getting the patterns correct.
- *  1  2  3  4
- *  5  6  7  8
- *  9 10 11 12
- * 13 14 15  0
- *
- * Reflected tiles.
- *  1  5  9 13
- *  2  6 10 14
- *  3  7 11 15
- *  4  8 12  0
- */
-
-#define PATTERN_0 1,5,6,9,10,13
-#define PATTERN_1 7,8,11,12,14,15
-#define PATTERN_2 2,3,4
-
-// The same pattern shapes but on the reflected tiles.
-#define REF_PATTERN_0 1,2,6,3,7,4
-#define REF_PATTERN_1 10,14,11,15,8,12
-#define REF_PATTERN_2 5,9,13
+// The packed solved board, tiles 1 to 15 in order followed by the empty tile.
+#define DIM4_SOLVED_BOARD 0x0FEDCBA987654321ULL
 
-#define PATTERN_0_LEN 6
-#define PATTERN_1_LEN 6
-#define PATTERN_2_LEN 3
+// The most patterns in a partition and the most partitions a solver uses.
+#define MAX_PATTERNS 8
+#define MAX_PARTITIONS 4
 
-#define PATTERN_0_ARRAY_OFFSET 0
-#define PATTERN_1_ARRAY_OFFSET 16777216  // 16^6
-#define PATTERN_2_ARRAY_OFFSET 33554432  // 16^6 * 2
+// The most characters, including the terminating null, in the name of a
+// partition and in the name of the file its heuristic values are saved in.
+#define MAX_PARTITION_NAME 32
+#define MAX_PARTITION_FILE 256
 
-#define TOTAL_STATES 33558528            // 16^6 * 2 + 16^3
-#define VISITED_STATES 268435456         // 16^7
-
-// Encapsulate data for a single tile pattern.
+// Encapsulate data for a single tile pattern, its tiles and the same pattern
+// shape reflected along the main diagonal, and where its heuristic values
+// start in the database of its partition in each layout.
 typedef struct
 {
     int tiles[DIM4_NUM_TILES];
     int reflected_tiles[DIM4_NUM_TILES];
     int num_tiles;
     long long array_offset;
+    long long compact_array_offset;
 }
 tile_pattern;
 
-// An array for all 3 patterns and their reflections along the main diagonal.
-const tile_pattern patterns[] = {
-  {{PATTERN_0}, {REF_PATTERN_0}, PATTERN_0_LEN, PATTERN_0_ARRAY_OFFSET},
-  {{PATTERN_1}, {REF_PATTERN_1}, PATTERN_1_LEN, PATTERN_1_ARRAY_OFFSET},
-  {{PATTERN_2}, {REF_PATTERN_2}, PATTERN_2_LEN, PATTERN_2_ARRAY_OFFSET},
-  };
+// Encapsulate a partition of the tiles into disjoint patterns, whose heuristic
+// values are added together, the file its database is saved in and the sizes
+// of that database in each layout, or 0 if it is not saved in that layout.
+// Partitions are declared in DIM4_PARTITIONS_FILE, see dim4_partitions.h.
+typedef struct
+{
+    char name[MAX_PARTITION_NAME];
+    char file[MAX_PARTITION_FILE];
+    tile_pattern patterns[MAX_PATTERNS];
+    int num_patterns;
+    long long total_states;
+    long long compact_total_states;
+}
+partition;
+
+// The layouts in which the database of a partition may be saved, given in the
+// header of its file, see heuristics_file.h.
+enum layout { SPARSE_LAYOUT, COMPACT_LAYOUT };
+
+// A database in either layout may also be packed into half the space. Since
+// every move of a pattern tile changes its Manhattan distance by one, a
+// pattern's heuristic value less the Manhattan distance of its tiles is even
+// and in practice small. Half of that difference is stored in 4 bits, two
+// values to a byte with the value at an even index in the low bits.
+#define PACKED_LENGTH(states) (((states) + 1) / 2)
 
 // We initialize an array to store the valid moves available for each
 // possible position on the board of the empty tile. Picturing the board in two
@@ -74,11 +77,52 @@ const tile_pattern patterns[] = {
 //               4  5  6  7      valid_moves[6]  = {2,7,10,5}
 //               8  9 10 11      valid_moves[8]  = {4,9,12,-1}
 //              12 13 14 15      valid_moves[15] = {11,-1,-1,14}
-const int valid_moves[DIM4_NUM_TILES][4] = {
+static const int valid_moves[DIM4_NUM_TILES][4] = {
     {-1,1,4,-1},  {-1,2,5,0},   {-1,3,6,1},    {-1,-1,7,2},
     {0,5,8,-1},   {1,6,9,4},    {2,7,10,5},    {3,-1,11,6},
     {4,9,12,-1},  {5,10,13,8},  {6,11,14,9},   {7,-1,15,10},
     {8,13,-1,-1}, {9,14,-1,12}, {10,15,-1,13}, {11,-1,-1,14}};
 
+/*
+ * For the given distinct locations of the n tiles of a pattern returns their
+ * rank amongst all 16!/(16-n)! such arrangements, the index of the pattern in
+ * the compact layout. Each digit of the rank is the location of a tile less
+ * the number of locations already taken by the tiles before it, so that the
+ * digits count down from 16 possibilities to 16 - n + 1.
+ */
+static inline int64_t compact_index(const int locations[], int num_tiles)
+{
+    int64_t index = 0;
+    unsigned int taken = 0;
+    for (int i = 0; i < num_tiles; i++)
+    {
+        unsigned int below = (1u << locations[i]) - 1;
+        index = index * (DIM4_NUM_TILES - i)
+                + locations[i] - __builtin_popcount(taken & below);
+        taken |= 1u << locations[i];
+    }
+    return index;
+}
+
+/*
+ * Returns the 4 bits at the given index of an array of packed values, see
+ * PACKED_LENGTH.
+ */
+static inline int packed_value(const uint8_t values[], int64_t index)
+{
+    return (values[index / 2] >> (index % 2 * 4)) & 0xf;
+}
+
+/*
+ * Returns the Manhattan distance of the numbered tile at the given location
+ * from its location in the solved board.
+ */
+static inline int manhattan_distance(int tile, int location)
+{
+    int rows = (tile - 1) / DIM4 - location / DIM4;
+    int cols = (tile - 1) % DIM4 - location % DIM4;
+    return (rows < 0 ? -rows : rows) + (cols < 0 ? -cols : cols);
+}
+
 #endif
 
@@ -0,0 +1,268 @@
+/**
+ * dim4_database.c
+ *
+ * This file builds the database of the 4x4 heuristics of a partition, see
+ * dim4_database.h. The heuristic values of each pattern are generated
+ * separately by generate_dim4_heuristics.c, and each is saved as a slice of
+ * its own as soon as its search is done. Once every slice is saved they are
+ * merged into the database, packing the values if asked, either by the
+ * generator itself or by merge_dim4_heuristics.c. A long generation stopped
+ * part way through so loses none of the patterns already finished.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dim4_database.h"
+#include "heuristics_file.h"
+
+/*
+ * Returns the number of arrangements of n tiles on the board, 16!/(16-n)!.
+ */
+int64_t num_arrangements(int num_tiles)
+{
+    int64_t arrangements = 1;
+    for (int i = 0; i < num_tiles; i++)
+    {
+        arrangements *= DIM4_NUM_TILES - i;
+    }
+    return arrangements;
+}
+
+/*
+ * Returns the number of heuristic values of the given pattern in the given
+ * layout.
+ */
+int64_t pattern_states(const tile_pattern *pattern, enum layout layout)
+{
+    return layout == COMPACT_LAYOUT ? num_arrangements(pattern->num_tiles)
+                                    : (int64_t) 1 << (4 * pattern->num_tiles);
+}
+
+/*
+ * Sets the locations of the n tiles of a pattern from their index in the
+ * given layout. Returns false if the index is of no arrangement of the tiles,
+ * which happens for some indices in the sparse layout.
+ */
+bool index_locations(int64_t index, int num_tiles, enum layout layout,
+                     int locations[])
+{
+    if (layout == SPARSE_LAYOUT)
+    {
+        unsigned int taken = 0;
+        for (int i = 0; i < num_tiles; i++)
+        {
+            locations[i] = (index >> (4 * i)) % DIM4_NUM_TILES;
+            if (taken & (1u << locations[i]))
+            {
+                return false;
+            }
+            taken |= 1u << locations[i];
+        }
+        return true;
+    }
+
+    // Undo compact_index in dim4.h, the last tile's digit being the least
+    // significant, then turn each digit back into a location by skipping
+    // over the locations taken by the tiles before it.
+    int digits[DIM4_NUM_TILES];
+    for (int i = num_tiles - 1; i >= 0; i--)
+    {
+        digits[i] = index % (DIM4_NUM_TILES - i);
+        index /= DIM4_NUM_TILES - i;
+    }
+    unsigned int taken = 0;
+    for (int i = 0; i < num_tiles; i++)
+    {
+        int location = -1;
+        for (int j = 0; j <= digits[i]; j++)
+        {
+            do
+            {
+                location++;
+            }
+            while (taken & (1u << location));
+        }
+        locations[i] = location;
+        taken |= 1u << location;
+    }
+    return true;
+}
+
+/*
+ * Packs the heuristics of the given partition and layout into half the space,
+ * see PACKED_LENGTH in dim4.h. Returns false if a value cannot be packed.
+ */
+bool pack_dim4_heuristics(const partition *partition, enum layout layout,
+                          const uint8_t heuristics[], uint8_t packed[])
+{
+    for (int i = 0; i < partition->num_patterns; i++)
+    {
+        tile_pattern pattern = partition->patterns[i];
+        int64_t offset = layout == COMPACT_LAYOUT
+                         ? pattern.compact_array_offset
+                         : pattern.array_offset;
+        int64_t states = pattern_states(&pattern, layout);
+        for (int64_t index = offset; index < offset + states; index++)
+        {
+            // Unused entries of the sparse layout are never looked up.
+            int extra = 0;
+            int locations[DIM4_NUM_TILES];
+            if (index_locations(index - offset, pattern.num_tiles, layout,
+                                locations))
+            {
+                extra = heuristics[index];
+                for (int j = 0; j < pattern.num_tiles; j++)
+                {
+                    extra -= manhattan_distance(pattern.tiles[j],
+                                                locations[j]);
+                }
+                if (extra < 0 || extra % 2 != 0 || extra / 2 > 0xf)
+                {
+                    return false;
+                }
+            }
+
+            if (index % 2 == 0)
+            {
+                packed[index / 2] = extra / 2;
+            }
+            else
+            {
+                packed[index / 2] |= (extra / 2) << 4;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Saves in filename the name of the file of the slice of the pattern with the
+ * given number, counting from 1, of the partition, such as
+ * 'dim4_heuristics.bin.1'.
+ */
+void dim4_slice_filename(const partition *partition, int number,
+                         char filename[MAX_SLICE_FILE])
+{
+    snprintf(filename, MAX_SLICE_FILE, "%s.%i", partition->file, number);
+}
+
+/*
+ * Writes the heuristic values of the pattern with the given number of the
+ * partition, in the given layout, to its slice. Returns false upon any error.
+ */
+bool write_dim4_slice(const partition *partition, int number,
+                      enum layout layout, const uint8_t heuristics[])
+{
+    const tile_pattern *pattern = &partition->patterns[number - 1];
+    heuristics_header header;
+    init_pattern_header(&header, DIM4_SLICE, pattern, layout,
+                        pattern_states(pattern, layout));
+    char filename[MAX_SLICE_FILE];
+    dim4_slice_filename(partition, number, filename);
+    return write_heuristics_file(filename, &header, heuristics);
+}
+
+/*
+ * Returns true if the slice of the pattern with the given number of the
+ * partition has been written, in the given layout, and is undamaged.
+ */
+bool have_dim4_slice(const partition *partition, int number,
+                     enum layout layout)
+{
+    const tile_pattern *pattern = &partition->patterns[number - 1];
+    char filename[MAX_SLICE_FILE];
+    dim4_slice_filename(partition, number, filename);
+    heuristics_header header;
+    const uint8_t *slice = map_heuristics_file(filename, DIM4_SLICE, true,
+                                               &header);
+    if (!slice)
+    {
+        return false;
+    }
+    bool matches = header_matches_pattern(&header, DIM4_SLICE, pattern,
+                                          layout,
+                                          pattern_states(pattern, layout));
+    unmap_heuristics_file(slice, header.length);
+    return matches;
+}
+
+/*
+ * Merges the slices of every pattern of the partition, in the given layout,
+ * into its database, packed or not, then removes the slices. Upon any error
+ * returns false and, unless error is NULL, describes the error in it.
+ */
+bool merge_dim4_slices(const partition *partition, enum layout layout,
+                       bool packed, char error[DATABASE_ERROR_CHARS])
+{
+    char unused[DATABASE_ERROR_CHARS];
+    error = error ? error : unused;
+
+    int64_t total_states = layout == COMPACT_LAYOUT
+                           ? partition->compact_total_states
+                           : partition->total_states;
+    uint8_t *heuristics = malloc(total_states);
+    if (!heuristics)
+    {
+        snprintf(error, DATABASE_ERROR_CHARS, "Out of memory");
+        return false;
+    }
+
+    // Copy each slice into place.
+    char filename[MAX_SLICE_FILE];
+    for (int i = 0; i < partition->num_patterns; i++)
+    {
+        const tile_pattern *pattern = &partition->patterns[i];
+        int64_t states = pattern_states(pattern, layout);
+        dim4_slice_filename(partition, i + 1, filename);
+        heuristics_header header;
+        const uint8_t *slice = map_heuristics_file(filename, DIM4_SLICE, true,
+                                                   &header);
+        if (slice && !header_matches_pattern(&header, DIM4_SLICE, pattern,
+                                             layout, states))
+        {
+            unmap_heuristics_file(slice, header.length);
+            slice = NULL;
+        }
+        if (!slice)
+        {
+            snprintf(error, DATABASE_ERROR_CHARS, "The slice %s is missing, "
+                     "damaged or of another pattern or layout", filename);
+            free(heuristics);
+            return false;
+        }
+        memcpy(&heuristics[header.offsets[0]], slice, states);
+        unmap_heuristics_file(slice, header.length);
+    }
+
+    // Pack the array in place, the packed values never overtaking those
+    // still to be read.
+    if (packed && !pack_dim4_heuristics(partition, layout, heuristics,
+                                        heuristics))
+    {
+        snprintf(error, DATABASE_ERROR_CHARS,
+                 "A heuristic value is too large to pack");
+        free(heuristics);
+        return false;
+    }
+
+    // Write the array to disk, after a header describing it.
+    heuristics_header header;
+    init_dim4_header(&header, partition, layout, packed);
+    if (!write_heuristics_file(partition->file, &header, heuristics))
+    {
+        snprintf(error, DATABASE_ERROR_CHARS, "Unable to write %s",
+                 partition->file);
+        free(heuristics);
+        return false;
+    }
+    free(heuristics);
+
+    for (int i = 0; i < partition->num_patterns; i++)
+    {
+        dim4_slice_filename(partition, i + 1, filename);
+        remove(filename);
+    }
+    return true;
+}
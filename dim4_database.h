@@ -0,0 +1,73 @@
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dim4.h"
+
+#ifndef DIM4_DATABASE_H
+#define DIM4_DATABASE_H
+
+// The most characters, including the terminating null, in the name of the file
+// of a slice, that of its partition followed by the pattern's number.
+#define MAX_SLICE_FILE (MAX_PARTITION_FILE + 16)
+
+// The most characters of a message describing an error in merging slices.
+#define DATABASE_ERROR_CHARS (MAX_SLICE_FILE + 64)
+
+/*
+ * Returns the number of arrangements of n tiles on the board, 16!/(16-n)!.
+ */
+int64_t num_arrangements(int num_tiles);
+
+/*
+ * Returns the number of heuristic values of the given pattern in the given
+ * layout.
+ */
+int64_t pattern_states(const tile_pattern *pattern, enum layout layout);
+
+/*
+ * Sets the locations of the n tiles of a pattern from their index in the
+ * given layout. Returns false if the index is of no arrangement of the tiles,
+ * which happens for some indices in the sparse layout.
+ */
+bool index_locations(int64_t index, int num_tiles, enum layout layout,
+                     int locations[]);
+
+/*
+ * Packs the heuristics of the given partition and layout into half the space,
+ * see PACKED_LENGTH in dim4.h. Returns false if a value cannot be packed.
+ */
+bool pack_dim4_heuristics(const partition *partition, enum layout layout,
+                          const uint8_t heuristics[], uint8_t packed[]);
+
+/*
+ * Saves in filename the name of the file of the slice of the pattern with the
+ * given number, counting from 1, of the partition, such as
+ * 'dim4_heuristics.bin.1'.
+ */
+void dim4_slice_filename(const partition *partition, int number,
+                         char filename[MAX_SLICE_FILE]);
+
+/*
+ * Writes the heuristic values of the pattern with the given number of the
+ * partition, in the given layout, to its slice. Returns false upon any error.
+ */
+bool write_dim4_slice(const partition *partition, int number,
+                      enum layout layout, const uint8_t heuristics[]);
+
+/*
+ * Returns true if the slice of the pattern with the given number of the
+ * partition has been written, in the given layout, and is undamaged.
+ */
+bool have_dim4_slice(const partition *partition, int number,
+                     enum layout layout);
+
+/*
+ * Merges the slices of every pattern of the partition, in the given layout,
+ * into its database, packed or not, then removes the slices. Upon any error
+ * returns false and, unless error is NULL, describes the error in it.
+ */
+bool merge_dim4_slices(const partition *partition, enum layout layout,
+                       bool packed, char error[DATABASE_ERROR_CHARS]);
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * dim4_partitions.c
+ *
+ * This file reads the partitions of the tiles into patterns used by the 4x4
+ * heuristics, which are declared in a text file so that both
+ * generate_dim4_heuristics.c and the solvers agree on them without being
+ * rebuilt, see dim4_partitions.h for the format.
+ *
+ * From the tiles of each pattern we work out the reflected pattern, where its
+ * heuristic values start in the database in each layout and how large the
+ * database is.
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dim4_partitions.h"
+
+// The most characters in a line of a partitions file.
+#define MAX_LINE_CHARS 1024
+
+// The characters separating the words of a line.
+#define SEPARATORS " \t\r\n"
+
+/*
+ * Reads the rest of a line of a partitions file, following its name, into the
+ * partition p. Returns NULL upon success or else a description of the error.
+ */
+static const char *parse_partition(char *name, char **rest, partition *p);
+
+/*
+ * Fills in where the heuristic values of each pattern of the partition p
+ * start and the total size of its database in each layout. Returns false if
+ * the database would be too large to index.
+ */
+static bool size_partition(partition *p);
+
+/*
+ * Returns the tile whose solved location is the reflection along the main
+ * diagonal of the solved location of the given tile.
+ */
+static int reflected_tile(int tile);
+
+
+/*
+ * Reads the partitions declared in the named file, such as
+ * DIM4_PARTITIONS_FILE, into partitions and returns how many there are. Each
+ * line of the file declares a partition by its name, the file its database is
+ * saved in and its patterns of tiles separated by '|', for example
+ *
+ *   6-6-3 dim4_heuristics.bin 1 5 6 9 10 13 | 7 8 11 12 14 15 | 2 3 4
+ *
+ * Every tile from 1 to 15 must be in exactly one pattern of a partition, and
+ * anything following a '#' is a comment. Upon any error returns -1 and,
+ * unless error is NULL, describes the error in it.
+ */
+int read_dim4_partitions(const char *filename,
+                         partition partitions[MAX_PARTITIONS],
+                         char error[PARTITIONS_ERROR_CHARS])
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        if (error)
+        {
+            snprintf(error, PARTITIONS_ERROR_CHARS, "Could not open %s",
+                     filename);
+        }
+        return -1;
+    }
+
+    int num_partitions = 0;
+    int line_number = 0;
+    const char *message = NULL;
+    char line[MAX_LINE_CHARS];
+    while (!message && fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        if (!strchr(line, '\n') && !feof(file))
+        {
+            message = "line is too long";
+            break;
+        }
+
+        // Skip comments and blank lines.
+        char *comment = strchr(line, '#');
+        if (comment)
+        {
+            *comment = '\0';
+        }
+        char *rest;
+        char *name = strtok_r(line, SEPARATORS, &rest);
+        if (!name)
+        {
+            continue;
+        }
+
+        if (num_partitions == MAX_PARTITIONS)
+        {
+            message = "too many partitions";
+            break;
+        }
+        partition *p = &partitions[num_partitions];
+        message = parse_partition(name, &rest, p);
+        for (int i = 0; !message && i < num_partitions; i++)
+        {
+            if (strcmp(partitions[i].name, p->name) == 0)
+            {
+                message = "the name of another partition";
+            }
+            else if (strcmp(partitions[i].file, p->file) == 0)
+            {
+                message = "the file of another partition";
+            }
+        }
+        num_partitions++;
+    }
+    fclose(file);
+
+    if (!message && num_partitions == 0)
+    {
+        message = "no partitions are declared";
+    }
+    if (message)
+    {
+        if (error)
+        {
+            snprintf(error, PARTITIONS_ERROR_CHARS, "%s:%i: %s", filename,
+                     line_number, message);
+        }
+        return -1;
+    }
+    return num_partitions;
+}
+
+/*
+ * Reads the rest of a line of a partitions file, following its name, into the
+ * partition p. Returns NULL upon success or else a description of the error.
+ */
+static const char *parse_partition(char *name, char **rest, partition *p)
+{
+    if (strlen(name) >= MAX_PARTITION_NAME)
+    {
+        return "the name is too long";
+    }
+    strcpy(p->name, name);
+
+    char *file = strtok_r(NULL, SEPARATORS, rest);
+    if (!file)
+    {
+        return "no file is given";
+    }
+    if (strlen(file) >= MAX_PARTITION_FILE)
+    {
+        return "the file name is too long";
+    }
+    strcpy(p->file, file);
+
+    // Read the tiles, starting a new pattern after each '|'.
+    p->num_patterns = 0;
+    tile_pattern *pattern = NULL;
+    unsigned int seen = 0;
+    char *word;
+    while ((word = strtok_r(NULL, SEPARATORS, rest)))
+    {
+        if (strcmp(word, "|") == 0)
+        {
+            if (!pattern)
+            {
+                return "a pattern has no tiles";
+            }
+            pattern = NULL;
+            continue;
+        }
+
+        char *end;
+        long tile = strtol(word, &end, 10);
+        if (*end != '\0' || tile < 1 || tile >= DIM4_NUM_TILES)
+        {
+            return "tiles must be numbers from 1 to 15";
+        }
+        if (seen & (1u << tile))
+        {
+            return "a tile is in more than one pattern";
+        }
+        seen |= 1u << tile;
+
+        if (!pattern)
+        {
+            if (p->num_patterns == MAX_PATTERNS)
+            {
+                return "too many patterns";
+            }
+            pattern = &p->patterns[p->num_patterns++];
+            pattern->num_tiles = 0;
+        }
+        pattern->tiles[pattern->num_tiles] = tile;
+        pattern->reflected_tiles[pattern->num_tiles] = reflected_tile(tile);
+        pattern->num_tiles++;
+    }
+
+    // The solvers add the Manhattan distance of every tile to the values of a
+    // packed database, so every tile must be in some pattern.
+    if (!pattern)
+    {
+        return "a pattern has no tiles";
+    }
+    if (seen != (1u << DIM4_NUM_TILES) - 2)
+    {
+        return "every tile from 1 to 15 must be in a pattern";
+    }
+    if (!size_partition(p))
+    {
+        return "the patterns are too large";
+    }
+    return NULL;
+}
+
+/*
+ * Fills in where the heuristic values of each pattern of the partition p
+ * start and the total size of its database in each layout. Returns false if
+ * the database would be too large to index.
+ */
+static bool size_partition(partition *p)
+{
+    // In the sparse layout a pattern of n tiles takes 16^n entries, which is
+    // only practical for patterns of up to 6 tiles. In the compact layout it
+    // takes 16!/(16-n)! entries.
+    bool sparse = true;
+    long long total_states = 0;
+    long long compact_total_states = 0;
+    for (int i = 0; i < p->num_patterns; i++)
+    {
+        tile_pattern *pattern = &p->patterns[i];
+        pattern->array_offset = total_states;
+        pattern->compact_array_offset = compact_total_states;
+
+        long long states = 1;
+        long long compact_states = 1;
+        for (int j = 0; j < pattern->num_tiles; j++)
+        {
+            states *= DIM4_NUM_TILES;
+            compact_states *= DIM4_NUM_TILES - j;
+            if (compact_states > INT_MAX)
+            {
+                return false;
+            }
+        }
+        sparse = sparse && pattern->num_tiles <= 6;
+        total_states += states;
+        compact_total_states += compact_states;
+    }
+
+    // The solvers index the database with an int.
+    if (compact_total_states > INT_MAX)
+    {
+        return false;
+    }
+    p->total_states = sparse ? total_states : 0;
+    p->compact_total_states = compact_total_states;
+    if (!sparse)
+    {
+        for (int i = 0; i < p->num_patterns; i++)
+        {
+            p->patterns[i].array_offset = -1;
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns the tile whose solved location is the reflection along the main
+ * diagonal of the solved location of the given tile.
+ */
+static int reflected_tile(int tile)
+{
+    int location = tile - 1;
+    return DIM4 * (location % DIM4) + location / DIM4 + 1;
+}
@@ -0,0 +1,26 @@
+
+#include "dim4.h"
+
+#ifndef DIM4_PARTITIONS_H
+#define DIM4_PARTITIONS_H
+
+// The most characters of a message describing an error in a partitions file.
+#define PARTITIONS_ERROR_CHARS 256
+
+/*
+ * Reads the partitions declared in the named file, such as
+ * DIM4_PARTITIONS_FILE, into partitions and returns how many there are. Each
+ * line of the file declares a partition by its name, the file its database is
+ * saved in and its patterns of tiles separated by '|', for example
+ *
+ *   6-6-3 dim4_heuristics.bin 1 5 6 9 10 13 | 7 8 11 12 14 15 | 2 3 4
+ *
+ * Every tile from 1 to 15 must be in exactly one pattern of a partition, and
+ * anything following a '#' is a comment. Upon any error returns -1 and,
+ * unless error is NULL, describes the error in it.
+ */
+int read_dim4_partitions(const char *filename,
+                         partition partitions[MAX_PARTITIONS],
+                         char error[PARTITIONS_ERROR_CHARS]);
+
+#endif
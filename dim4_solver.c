@@ -1,8 +1,9 @@
 /**
  * dim4_solver.c
  *
- * This file defines the functions required for optimal solutions to 4x4
- * fifteen puzzles (or the 4x4 lower right corner of a larger puzzle).
+ * This file defines libfifteen's optimal solver for 4x4 fifteen puzzles, used
+ * by both the game and standalone_dim4_solver.c, see dim4_solver.h for its
+ * interface.
  *
  * The method used is an A* iterative deepening search using a heuristic
  * previously generated by the program generate_dim4_heuristics.c.
@@ -18,334 +19,2478 @@
  * Since the heuristic never overestimates the actual cost to reach the
  * solution, the first solution we find will be optimal in the total number of
  * moves required.
+ *
+ * Without that database a weaker heuristic is built in memory instead, the
+ * larger of the walking distance, (a measure devised by Ken'ichiro Takahashi
+ * which counts the moves needed to bring every tile into its goal row and
+ * separately its goal column), and the Manhattan distance plus linear
+ * conflicts, (the extra moves needed by tiles in their goal row or column but
+ * in the wrong order), see build_dim4_walking_distance.
+ *
+ * Nothing here refers to the game's puzzle, and all the state of a solve is
+ * held in a dim4_context, so any number of puzzles may be solved at once by
+ * different threads. The lookup tables which depend on no database are filled
+ * in once, whichever thread gets there first, and the rest belong to each
+ * loaded database.
  */
 
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "dim4.h"
-#include "fifteen.h"
+#include "dim4_partitions.h"
+#include "dim4_solver.h"
+#include "heuristics_file.h"
+#include "map_file.h"
+
+// When searching in parallel, the search tree is split into at least this many
+// subtrees per thread so that work can be balanced between threads.
+#define SUBTREES_PER_THREAD 32
+
+// Boards are only looked up in a transposition table when at least this many
+// moves are left within the bound. Nearer the leaves of the search tree the
+// few nodes saved don't pay for the cache misses of the look ups.
+#define TABLE_MIN_MOVES_LEFT 16
+
+// The number of states of the walking distance of the rows of a board, see
+// init_walking_distance.
+#define NUM_WALKING_STATES 24964
+
+// The number of codes for the tiles of a line, a row or column, of a board
+// for linear conflicts, 5^4, see line_conflicts.
+#define NUM_LINE_CODES 625
+
+// Minimum number of characters for a line of text to be a valid puzzle, see
+// read_dim4_board.
+#define MINIMUM_BOARD_CHARS 37
 
 // Encapsulate the current state of the board, including the moves made since
 // initialization, with a struct node.
 typedef struct
 {
-    int board[DIM4_NUM_TILES];
+    // The board packed into 64 bits, see DIM4_PACK in dim4.h.
+    uint64_t board;
+    // The inverse of board packed in the same way, i.e. the index of each
+    // tile on the board, so that tiles can be located without a search.
+    uint64_t positions;
+    // The Zobrist hash of the board, see init_tables.
+    uint64_t hash;
     int empty_index;
     int heuristic;
+    // For each table of the database, the index into its heuristics array,
+    // and the heuristic value found there, for each pattern and for each
+    // reflected pattern. Along with the sums of those values for each table
+    // these are updated incrementally as tiles move. Without a database the
+    // first index is the state of the walking distance of the rows, and the
+    // first reflected index that of the columns, the rows of the reflected
+    // board.
+    int index[MAX_PARTITIONS][MAX_PATTERNS];
+    int reflected_index[MAX_PARTITIONS][MAX_PATTERNS];
+    uint8_t value[MAX_PARTITIONS][MAX_PATTERNS];
+    uint8_t reflected_value[MAX_PARTITIONS][MAX_PATTERNS];
+    int sum[MAX_PARTITIONS];
+    int reflected_sum[MAX_PARTITIONS];
+    // When any table is packed, the Manhattan distance of all the tiles,
+    // which is added to the larger of the sums of a packed table. Without a
+    // database, the Manhattan distance and the linear conflicts.
+    int distance;
+    int conflicts;
     int num_moves;
-    // A solution will have at most 80 moves.
-    // http://www.iro.umontreal.ca/~gendron/Pisa/References/BB/Brungger99.pdf
-    int moves[80];
+    uint8_t moves[DIM4_MAX_MOVES];
+}
+node;
+
+// A frame of the explicit stack of a depth-first search for each node on the
+// path from the root of the search. The moves from the node, in the order
+// they are made and with the heuristic after each, see order_moves, the next
+// of those moves to make, and the least bound found so far below the node.
+typedef struct
+{
+    uint8_t directions[4];
+    uint8_t heuristics[4];
+    uint8_t num_directions;
+    uint8_t next;
+    int new_bound;
+}
+frame;
+
+// An entry of a transposition table, a board and the fewest moves with which
+// it has been reached during the iteration of the search with the given
+// stamp.
+typedef struct
+{
+    uint64_t board;
+    uint32_t iteration;
+    uint8_t num_moves;
+}
+table_entry;
+
+// A fixed size, lossy table of the boards reached by a depth-first search,
+// indexed by their hashes. A board is only remembered until another board
+// with the same index replaces it. Every iteration of the search, and every
+// puzzle, has a new stamp so that old entries are never matched.
+typedef struct
+{
+    table_entry *entries;
+    uint64_t mask;
+    uint32_t iteration;
+}
+transposition_table;
+
+// The state of a single depth-first search. A puzzle may be solved by several
+// such searches exploring disjoint subtrees of the search tree in parallel.
+typedef struct
+{
+    const pattern_database *database;
+    // The transposition table of the thread making the search, or NULL.
+    transposition_table *table;
+    // Whether the moves from each node are made in order of their heuristic,
+    // see order_moves.
+    bool ordered;
+    // The index of the subtree being explored. Subtrees are numbered in the
+    // order that a single depth-first search would reach them.
+    int subtree;
+    // Shared by all the searches for a puzzle, the least index of a subtree in
+    // which a solution has been found, or INT_MAX if there is none yet.
+    atomic_int *solved_subtree;
+    // Tracks when this search reaches the solved state.
+    bool solved;
+    // The explicit stack of frames for the nodes on the path from the root of
+    // the search to the current node.
+    int depth;
+    frame stack[DIM4_MAX_MOVES + 1];
+    // The number of nodes expanded, over every search made with s.
+    long nodes;
+}
+search;
+
+// A range of subtree indices waiting to be searched by a thread. The thread
+// which owns the range takes subtrees from the front whilst other threads
+// which have run out of work steal subtrees from the back.
+typedef struct
+{
+    pthread_mutex_t lock;
+    int front;
+    int back;
+}
+work_queue;
+
+// The state shared by the threads of a parallel search for a single bound.
+typedef struct
+{
+    const pattern_database *database;
+    // A transposition table for each thread, or NULL.
+    transposition_table *tables;
+    // Whether moves are made in order of their heuristic, see order_moves.
+    bool ordered;
+    // The roots of the subtrees to search, in depth-first order, and the bound
+    // for the search, measured from the root of the whole search tree.
+    node *subtrees;
+    int num_subtrees;
+    int bound;
+    // A queue of subtrees for each thread.
+    work_queue *queues;
+    int num_threads;
+    // The least index of a subtree in which a solution has been found.
+    atomic_int solved_subtree;
+    // Guards the following members which collect the threads' results.
+    pthread_mutex_t lock;
+    int new_bound;
+    node solution;
+    long nodes;
+}
+parallel_search;
+
+// The argument passed to each thread of a parallel search.
+typedef struct
+{
+    parallel_search *ps;
+    int thread;
+}
+worker;
+
+// The heuristic values of a single partition, mapped from its file, together
+// with the lookup tables for its patterns.
+typedef struct
+{
+    const uint8_t *values;
+    size_t length;
+    enum layout layout;
+    bool packed;
+    const partition *partition;
+
+    // For each tile, the pattern it belongs to and the place value it
+    // contributes to that pattern's index, together with the same for the
+    // reflected patterns. Since a move changes the location of a single tile,
+    // these let us update the index of just the one pattern (and one
+    // reflected pattern) that changes.
+    int pattern_of_tile[DIM4_NUM_TILES];
+    int place_of_tile[DIM4_NUM_TILES];
+    int reflected_pattern_of_tile[DIM4_NUM_TILES];
+    int reflected_place_of_tile[DIM4_NUM_TILES];
+
+    // For each tile, the place value it contributes to its pattern's index in
+    // the compact layout, together with the same for the reflected patterns.
+    int compact_place_of_tile[DIM4_NUM_TILES];
+    int reflected_compact_place_of_tile[DIM4_NUM_TILES];
+
+    // When a tile moves past another tile of the same pattern, the digit of
+    // whichever of the two comes later in the pattern changes by one. For a
+    // tile t moving to a higher location past a tile u, crossing_change[t][u]
+    // is the resulting change in the compact index, and it is zero for tiles
+    // of different patterns.
+    int crossing_change[DIM4_NUM_TILES][DIM4_NUM_TILES];
+    int reflected_crossing_change[DIM4_NUM_TILES][DIM4_NUM_TILES];
+}
+pattern_table;
+
+// A database of heuristic values as loaded by load_dim4_heuristics, the
+// partitions declared in DIM4_PARTITIONS_FILE and a table for each of those
+// whose heuristic values could be loaded. The heuristic is the largest of the
+// tables' heuristics.
+struct pattern_database
+{
+    partition partitions[MAX_PARTITIONS];
+    pattern_table tables[MAX_PARTITIONS];
+    int num_tables;
+    // Whether any table is packed.
+    bool packed;
+    // Whether, instead of a database on disk, the heuristic is the walking
+    // distance built in memory by build_dim4_walking_distance, in which case
+    // there are no tables.
+    bool walking_distance;
+};
+
+// The state kept between the puzzles solved with a context, see
+// create_dim4_context in dim4_solver.h.
+struct dim4_context
+{
+    const pattern_database *database;
+    int num_threads;
+    // Whether moves are made in order of their heuristic, see order_moves.
+    bool ordered;
+    // A transposition table for each thread, or NULL.
+    transposition_table *tables;
+    // The root of the search and, once found, the solution.
+    node root;
+    node solution;
+    // The number of nodes expanded solving the last puzzle.
+    long nodes;
+};
+
+// The database shared by all the callers of load_shared_dim4_heuristics, once
+// it has been loaded, guarded by its lock.
+static pattern_database *shared_database = NULL;
+static pthread_mutex_t shared_database_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Ensures init_tables is called only once.
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// The walking distance of the rows of a board is the number of moves needed to
+// bring every tile into its goal row, ignoring which column it is in. A state
+// of the rows counts for each row the tiles in it of each goal row, as well as
+// giving the row of the empty tile. walking_states holds the code of each
+// state, see walking_code, in increasing order. walking_distances holds the
+// distance of each state from the solved state, and walking_links[s][j][g] is
+// the state after a tile of goal row g moves into the empty tile's row of the
+// state s from the row above it if j is 0, or below it if j is 1. The same
+// tables give the walking distance of the columns using the reflected board.
+static uint64_t walking_states[NUM_WALKING_STATES];
+static uint8_t walking_distances[NUM_WALKING_STATES];
+static uint16_t walking_links[NUM_WALKING_STATES][2][DIM4];
+
+// For a line of tiles, a row or column of a board, the fewest moves beyond the
+// Manhattan distance of its tiles needed to get those tiles whose goal is in
+// the line past each other, indexed by the code for the line, see
+// line_conflicts. line_digit[c][l][tile] gives the tile's digit in the code
+// for row l, or if c is 1 for column l.
+static uint8_t linear_conflicts[NUM_LINE_CODES];
+static int line_digit[2][DIM4][DIM4_NUM_TILES];
+
+// The heuristic used without a database, see build_dim4_walking_distance,
+// built only once.
+static pattern_database walking_database;
+static pthread_once_t walking_once = PTHREAD_ONCE_INIT;
+
+// For the empty tile at index i and a move from direction j of valid_moves,
+// the board indices of the three locations passed over by the moved tile in
+// the order used for the compact index, if there are any.
+static int passed_locations[DIM4_NUM_TILES][4][3];
+static int reflected_passed_locations[DIM4_NUM_TILES][4][3];
+
+// The Manhattan distance of each tile at each board index, zero for the empty
+// tile.
+static int distance_of_tile[DIM4_NUM_TILES][DIM4_NUM_TILES];
+
+// The location of each board index under reflection about the main diagonal.
+static int reflected_location[DIM4_NUM_TILES];
+
+// A random number for each numbered tile at each board index, zero for the
+// empty tile. The Zobrist hash of a board is all those for its tiles xor'd
+// together, so a move changes the hash by the numbers for just one tile.
+static uint64_t zobrist[DIM4_NUM_TILES][DIM4_NUM_TILES];
+
+// For the empty tile at index i and a move from direction j of valid_moves,
+// adding the moved tile times board_deltas[i][j] to a packed board makes the
+// move. Similarly, adding the distance moved times position_deltas[tile] to
+// the packed positions updates the locations of both the tile and the empty
+// tile.
+static uint64_t board_deltas[DIM4_NUM_TILES][4];
+static uint64_t position_deltas[DIM4_NUM_TILES];
+
+/*
+ * Performs the same search as depth_first_search from the root node but
+ * splits the search tree into subtrees which are searched by num_threads
+ * threads. The solution found, if any, is the same as for a single search
+ * and is saved in the node solution. Adds the number of nodes the threads
+ * expanded to *nodes. Returns the least bound that could be used for another
+ * search, 0 if solved, or -1 upon an error.
+ */
+static int parallel_depth_first_search(node *root, int bound,
+                                       const pattern_database *database,
+                                       int num_threads, bool ordered,
+                                       transposition_table *tables,
+                                       node *solution, long *nodes);
+
+/*
+ * Appends to the array *subtrees the nodes at the given depth of the search
+ * tree below the node n, in depth-first order, which are within the bound.
+ * Nodes in the solved state are also appended, even above that depth.
+ * Returns the least bound of those nodes cut off or INT_MAX, or -1 if memory
+ * could not be allocated.
+ */
+static int split_search_tree(node *n, int bound, int depth,
+                             node **subtrees, int *num_subtrees,
+                             int *capacity, const pattern_database *database,
+                             bool ordered);
+
+/*
+ * The work of a single thread in a parallel search. Repeatedly takes a subtree
+ * from its own queue, or steals one from the queue of another thread, and
+ * searches it until no subtrees remain.
+ */
+static void *search_subtrees(void *arg);
+
+/*
+ * Removes a subtree index from the queue of the given thread of the parallel
+ * search ps, stealing from the other threads if needed. Returns -1 if there
+ * are no subtrees left.
+ */
+static int take_subtree(parallel_search *ps, int thread);
+
+/*
+ * Starting from the given node, and using heuristics provided by the search s,
+ * performs a depth first search cutting off search branches when the
+ * estimated costs exceed the bound. Once complete, returns the least bound
+ * that could be used for another such search at a greater depth. If at any
+ * point the search reaches the goal state, the search terminates having saved
+ * the solution path in the node n. The search also terminates early if a
+ * solution is found in a subtree preceding the one s is exploring.
+ */
+static int depth_first_search(node *n, int bound, search *s);
+
+/*
+ * Pushes a frame for the node n onto the stack of the search s, unless n is in
+ * the solved state in which case the search is marked solved.
+ */
+static inline void enter_node(node *n, search *s);
+
+/*
+ * Fills directions with the directions of valid_moves from which a tile can be
+ * moved into the empty tile's location of the node n, except to undo the
+ * previous move, and returns how many there are. If ordered, they are sorted
+ * by the heuristic after the move, least first, with ties kept in the order
+ * of valid_moves, and those heuristics are saved in heuristics.
+ */
+static inline int order_moves(const node *n, bool ordered,
+                              const pattern_database *database,
+                              uint8_t directions[4], uint8_t heuristics[4]);
+
+/*
+ * Allocates each of the given number of transposition tables with as many
+ * entries as fit in size bytes. Returns false upon an error.
+ */
+static bool init_transposition_tables(transposition_table tables[],
+                                      int num_tables, size_t size);
+
+/*
+ * Frees the entries of the given number of transposition tables.
+ */
+static void free_transposition_tables(transposition_table tables[],
+                                      int num_tables);
+
+/*
+ * Returns true if the board of the node n has already been reached with no
+ * more moves during the current iteration of the search using the table, in
+ * which case nothing new can be found below it. Otherwise records the board
+ * and returns false.
+ */
+static bool seen_before(transposition_table *table, const node *n);
+
+/*
+ * Returns the next of a sequence of pseudorandom numbers, splitmix64, from the
+ * given state.
+ */
+static uint64_t next_random(uint64_t *state);
+
+/*
+ * Fills in the lookup tables used to make moves on packed boards, and those
+ * shared by the patterns of every partition. Called once, see tables_once.
+ */
+static void init_tables(void);
+
+/*
+ * Fills in the lookup tables of the table used to incrementally update the
+ * indices of the patterns of its partition.
+ */
+static void init_pattern_tables(pattern_table *table);
+
+/*
+ * Fills passed with the board indices of the locations strictly between the
+ * locations from and to, in the order used for the compact index of a pattern
+ * or if reflected a reflected pattern. If there are none, uses from instead.
+ */
+static void fill_passed_locations(int passed[3], int from, int to,
+                                  bool reflected);
+
+/*
+ * Fills in the tables of the walking distance and of linear conflicts, and
+ * the database which uses them. Called once, see walking_once.
+ */
+static void init_walking_distance(void);
+
+/*
+ * Appends to walking_states, which already holds num_states states, those
+ * states of the walking distance with the given counts before the given cell,
+ * numbering the cells of counts row by row, and the given row of the empty
+ * tile. Returns the new number of states.
+ */
+static int add_walking_states(int counts[DIM4][DIM4], int cell, int empty_row,
+                              int num_states);
+
+/*
+ * Returns the code of the state of the walking distance in which counts[r][g]
+ * tiles of goal row g are in row r and the empty tile is in empty_row. The
+ * codes increase with the empty tile's row.
+ */
+static uint64_t walking_code(int counts[DIM4][DIM4], int empty_row);
+
+/*
+ * Compares two codes of states of the walking distance for qsort and bsearch.
+ */
+static int compare_codes(const void *a, const void *b);
+
+/*
+ * Returns the state of the walking distance of the rows of the board given by
+ * its packed positions, or if reflected of its columns.
+ */
+static int walking_state(uint64_t positions, bool reflected);
+
+/*
+ * Returns the heuristic used without a database for the node n after sliding
+ * the tile from the given direction of valid_moves into the empty tile's
+ * location, without making the move. Unless after is NULL, also saves the
+ * states of the walking distance, the Manhattan distance and the linear
+ * conflicts after the move in the node after, which may be n itself.
+ */
+static inline int walking_distance_after_move(const node *n, int direction,
+                                              node *after);
+
+/*
+ * Returns the linear conflicts of the given row of the packed board, or if
+ * column is true of the given column.
+ */
+static inline int line_conflicts(uint64_t board, int line, bool column);
+
+/*
+ * Sets the tile positions, hash, pattern indices, heuristic values and sums
+ * held in the node n from scratch using its board.
+ */
+static void init_node_heuristic(node *n, const pattern_database *database);
+
+/*
+ * Slides the tile from the given direction of valid_moves into the empty
+ * tile's location, updating the board, the pattern indices and the heuristic
+ * of the node n. Only the pattern and reflected pattern of each table
+ * containing the moved tile are looked up again.
+ */
+static void move_tile(node *n, int direction,
+                      const pattern_database *database);
+
+/*
+ * Returns the heuristic of the node n after sliding the tile from the given
+ * direction of valid_moves into the empty tile's location, without making the
+ * move. See move_tile.
+ */
+static inline int heuristic_after_move(const node *n, int direction,
+                                       const pattern_database *database);
+
+/*
+ * Updates the pattern indices, heuristic values, sums and heuristic of the
+ * first num_tables tables of the database, all of them, for the node n after
+ * the given tile has moved from the given direction of valid_moves into the
+ * location to.
+ */
+static inline void update_tables(node *n, int tile, int to, int direction,
+                                 const pattern_database *database,
+                                 int num_tables);
+
+/*
+ * Returns the heuristic of the node n, using the first num_tables tables of
+ * the database, all of them, after sliding the tile from the given direction
+ * of valid_moves into the empty tile's location, without making the move.
+ */
+static inline int tables_after_move(const node *n, int direction,
+                                    const pattern_database *database,
+                                    int num_tables);
+
+/*
+ * Returns the heuristic of a board given the sums of the heuristic values of
+ * the patterns and reflected patterns of the first num_tables tables of the
+ * database, all of them, and the Manhattan distance if any table is packed.
+ * This is the largest over the tables of the larger of the two sums and, if
+ * the empty tile at empty_index is in its solved location, the sums for the
+ * dual of the board, see dual_sum.
+ */
+static inline int combine_sums(const pattern_database *database,
+                               int num_tables, const int sum[],
+                               const int reflected_sum[], int distance,
+                               uint64_t board, int empty_index);
+
+/*
+ * Returns the change in the compact index of the pattern of the table, or if
+ * reflected the reflected pattern, containing tile when it has moved from the
+ * given direction of valid_moves to the location to on the given board.
+ * Besides the tile's own digit, only the digits of tiles of the same pattern
+ * it passes over change, so horizontal moves, (vertical in the reflected
+ * board), change only the one digit.
+ */
+static inline int compact_change(const pattern_table *table, uint64_t board,
+                                 int tile, int to, int direction,
+                                 bool reflected);
+
+/*
+ * Returns the heuristic value at the given index of the table. For a packed
+ * table this excludes the Manhattan distance of the pattern's tiles, which
+ * the node tracks separately.
+ */
+static inline int lookup_value(const pattern_table *table, int index);
+
+/*
+ * Returns the packed positions of the tiles of the dual of the given packed
+ * board, which must have the empty tile in its solved location.
+ */
+static uint64_t dual_positions(uint64_t board);
+
+/*
+ * Returns the larger of the sums of the heuristic values of the patterns and
+ * of the reflected patterns of the table for the dual of a board, given the
+ * dual's packed positions.
+ */
+static int dual_sum(uint64_t positions, const pattern_table *table);
+
+/*
+ * Maps the heuristic values of the given partition into the table, reading
+ * their layout and packing from the header of the file, and fills in the
+ * table's lookup tables. Returns false upon any error.
+ */
+static bool load_table(pattern_table *table, const partition *partition);
+
+/*
+ * For the given positions of tiles and a tile pattern returns the index of the
+ * pattern's heuristic value in a database of the given layout, based on where
+ * the tiles in the pattern are on the board.
+ */
+static int pattern_index(uint64_t positions, const tile_pattern *pattern,
+                         bool reflected, enum layout layout);
+
+/*
+ * Swaps the contents of array[i] and array[j], increments a swap counter.
+ */
+static void swap(int array[], int i, int j, int *swap_count);
+
+/*
+ * Quicksorts an array between indices low and high inclusive. Also counts the
+ * number of swaps made whilst sorting.
+ */
+static void quicksort(int array[], int low, int high, int *swap_count);
+
+
+/*
+ * Returns a new context for solving puzzles with the given database, which
+ * must outlive the context. Each search uses num_threads threads, each with a
+ * transposition table of table_size bytes unless table_size is 0, and makes
+ * moves in order of their heuristic if ordered. Returns NULL upon an error.
+ */
+dim4_context *create_dim4_context(const pattern_database *database,
+                                  int num_threads, size_t table_size,
+                                  bool ordered)
+{
+    if (!database || num_threads < 1)
+    {
+        return NULL;
+    }
+    dim4_context *context = malloc(sizeof(dim4_context));
+    if (!context)
+    {
+        return NULL;
+    }
+    context->database = database;
+    context->num_threads = num_threads;
+    context->ordered = ordered;
+    context->nodes = 0;
+
+    // The tables are kept from one puzzle to the next.
+    context->tables = NULL;
+    if (table_size)
+    {
+        context->tables = malloc(num_threads * sizeof(transposition_table));
+        if (!context->tables
+            || !init_transposition_tables(context->tables, num_threads,
+                                          table_size))
+        {
+            free(context->tables);
+            free(context);
+            return NULL;
+        }
+    }
+    return context;
+}
+
+/*
+ * Releases a context returned by create_dim4_context.
+ */
+void free_dim4_context(dim4_context *context)
+{
+    if (context->tables)
+    {
+        free_transposition_tables(context->tables, context->num_threads);
+        free(context->tables);
+    }
+    free(context);
+}
+
+/*
+ * Returns the number of nodes expanded by the searches of the context for the
+ * last puzzle it solved. A parallel search leaves out the few nodes expanded
+ * in splitting the search tree between the threads.
+ */
+long dim4_nodes_expanded(const dim4_context *context)
+{
+    return context->nodes;
+}
+
+/*
+ * Returns the heuristic value the database gives a board of the tiles 0 to
+ * 15, a lower bound on the number of moves to solve it, or -1 if the board is
+ * not a solvable puzzle.
+ */
+int dim4_heuristic(const pattern_database *database,
+                   const int board[DIM4_NUM_TILES])
+{
+    if (!is_dim4_solvable(board))
+    {
+        return -1;
+    }
+    node n;
+    n.board = 0;
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
+    {
+        if (board[i] == 0)
+        {
+            n.empty_index = i;
+        }
+        n.board += DIM4_PACK(board[i], i);
+    }
+    init_node_heuristic(&n, database);
+    return n.heuristic;
+}
+
+/*
+ * Given a context and a board of the tiles 0 to 15, with 0 the empty tile,
+ * calls successive heuristic-guided depth-first searches until an optimal
+ * solution is found to the puzzle. Saves the tiles to move in turn in moves
+ * and returns how many there are. Returns -1 if the board is not a solvable
+ * puzzle or upon an error.
+ */
+int dim4_solver(dim4_context *context, const int board[DIM4_NUM_TILES],
+                uint8_t moves[DIM4_MAX_MOVES])
+{
+    if (!is_dim4_solvable(board))
+    {
+        return -1;
+    }
+    const pattern_database *database = context->database;
+    int num_threads = context->num_threads;
+    bool ordered = context->ordered;
+    transposition_table *tables = context->tables;
+
+    // Setup a root node.
+    node *root = &context->root;
+    root->board = 0;
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
+    {
+        if (board[i] == 0)
+        {
+            root->empty_index = i;
+        }
+        root->board += DIM4_PACK(board[i], i);
+    }
+    root->num_moves = 0;
+    init_node_heuristic(root, database);
+
+    // Use the heuristic as the initial bound for successive A* depth-first
+    // searches.
+    node *solution = root;
+    atomic_int solved_subtree = INT_MAX;
+    search s = {database, tables, ordered, 0, &solved_subtree, false};
+    int bound = root->heuristic;
+    while (!s.solved)
+    {
+        // Boards recorded by earlier searches must not be matched.
+        for (int i = 0; tables && i < num_threads; i++)
+        {
+            tables[i].iteration++;
+        }
+
+        if (num_threads > 1)
+        {
+            solution = &context->solution;
+            bound = parallel_depth_first_search(root, bound, database,
+                                                num_threads, ordered, tables,
+                                                solution, &s.nodes);
+            s.solved = bound == 0;
+        }
+        else
+        {
+            bound = depth_first_search(root, bound, &s);
+        }
+        if (bound == INT_MAX || bound == -1)
+        {
+            return -1;
+        }
+    }
+
+    context->nodes = s.nodes;
+    memcpy(moves, solution->moves, solution->num_moves);
+    return solution->num_moves;
+}
+
+/*
+ * Performs the same search as depth_first_search from the root node but
+ * splits the search tree into subtrees which are searched by num_threads
+ * threads. The solution found, if any, is the same as for a single search
+ * and is saved in the node solution. Adds the number of nodes the threads
+ * expanded to *nodes. Returns the least bound that could be used for another
+ * search, 0 if solved, or -1 upon an error.
+ */
+static int parallel_depth_first_search(node *root, int bound,
+                                       const pattern_database *database,
+                                       int num_threads, bool ordered,
+                                       transposition_table *tables,
+                                       node *solution, long *nodes)
+{
+    parallel_search ps;
+    ps.database = database;
+    ps.tables = tables;
+    ps.ordered = ordered;
+    ps.bound = bound;
+    ps.num_threads = num_threads;
+    atomic_init(&ps.solved_subtree, INT_MAX);
+
+    // Split the search tree at the shallowest depth giving enough subtrees to
+    // keep every thread busy. Any cut off nodes above that depth contribute
+    // to the next bound.
+    int capacity = 0;
+    int split_bound;
+    ps.subtrees = NULL;
+    for (int depth = 1; ; depth++)
+    {
+        ps.num_subtrees = 0;
+        split_bound = split_search_tree(root, bound, depth, &ps.subtrees,
+                                        &ps.num_subtrees, &capacity,
+                                        database, ordered);
+        if (split_bound == -1)
+        {
+            free(ps.subtrees);
+            return -1;
+        }
+        if (ps.num_subtrees >= num_threads * SUBTREES_PER_THREAD
+            || depth >= bound)
+        {
+            break;
+        }
+    }
+
+    // Deal out consecutive runs of subtrees to each thread so that each
+    // thread starts on subtrees near to one another in the search tree.
+    ps.queues = malloc(num_threads * sizeof(work_queue));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    worker *workers = malloc(num_threads * sizeof(worker));
+    if (!ps.queues || !threads || !workers)
+    {
+        free(ps.subtrees);
+        free(ps.queues);
+        free(threads);
+        free(workers);
+        return -1;
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_mutex_init(&ps.queues[i].lock, NULL);
+        ps.queues[i].front = (long) ps.num_subtrees * i / num_threads;
+        ps.queues[i].back = (long) ps.num_subtrees * (i + 1) / num_threads;
+    }
+    pthread_mutex_init(&ps.lock, NULL);
+    ps.new_bound = INT_MAX;
+    ps.nodes = 0;
+
+    // Search all the subtrees. Should a thread fail to start, its queue is
+    // simply stolen from by the others.
+    int num_started = 0;
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers[i].ps = &ps;
+        workers[i].thread = i;
+        if (pthread_create(&threads[num_started], NULL, search_subtrees,
+                           &workers[i]) == 0)
+        {
+            num_started++;
+        }
+    }
+    if (num_started == 0)
+    {
+        search_subtrees(&workers[0]);
+    }
+    for (int i = 0; i < num_started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    *nodes += ps.nodes;
+    int new_bound = ps.new_bound;
+    if (split_bound < new_bound)
+    {
+        new_bound = split_bound;
+    }
+    if (atomic_load(&ps.solved_subtree) != INT_MAX)
+    {
+        *solution = ps.solution;
+        new_bound = 0;
+    }
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_mutex_destroy(&ps.queues[i].lock);
+    }
+    pthread_mutex_destroy(&ps.lock);
+    free(ps.subtrees);
+    free(ps.queues);
+    free(threads);
+    free(workers);
+    return new_bound;
+}
+
+/*
+ * Appends to the array *subtrees the nodes at the given depth of the search
+ * tree below the node n, in depth-first order, which are within the bound.
+ * Nodes in the solved state are also appended, even above that depth.
+ * Returns the least bound of those nodes cut off or INT_MAX, or -1 if memory
+ * could not be allocated.
+ */
+static int split_search_tree(node *n, int bound, int depth,
+                             node **subtrees, int *num_subtrees,
+                             int *capacity, const pattern_database *database,
+                             bool ordered)
+{
+    if (n->num_moves == depth || n->board == DIM4_SOLVED_BOARD)
+    {
+        if (*num_subtrees == *capacity)
+        {
+            int new_capacity = *capacity ? 2 * *capacity : 256;
+            node *new_subtrees = realloc(*subtrees,
+                                         new_capacity * sizeof(node));
+            if (!new_subtrees)
+            {
+                return -1;
+            }
+            *subtrees = new_subtrees;
+            *capacity = new_capacity;
+        }
+        (*subtrees)[(*num_subtrees)++] = *n;
+        return INT_MAX;
+    }
+
+    // Visit the neighbours exactly as depth_first_search does, here with the
+    // bound measured from the root.
+    int new_bound = INT_MAX;
+    uint8_t directions[4];
+    uint8_t heuristics[4];
+    int num_directions = order_moves(n, ordered, database, directions,
+                                     heuristics);
+    for (int k = 0; k < num_directions; k++)
+    {
+        int i = directions[k];
+        int tile = DIM4_UNPACK(n->board, valid_moves[n->empty_index][i]);
+        move_tile(n, i, database);
+        n->moves[n->num_moves] = tile;
+        n->num_moves += 1;
+
+        int b = n->num_moves + n->heuristic;
+        if (b <= bound)
+        {
+            b = split_search_tree(n, bound, depth, subtrees, num_subtrees,
+                                  capacity, database, ordered);
+        }
+        if (b < new_bound)
+        {
+            new_bound = b;
+        }
+
+        move_tile(n, (i + 2) % 4, database);
+        n->num_moves -= 1;
+        n->moves[n->num_moves] = 0;
+
+        if (new_bound == -1)
+        {
+            return -1;
+        }
+    }
+    return new_bound;
+}
+
+/*
+ * The work of a single thread in a parallel search. Repeatedly takes a subtree
+ * from its own queue, or steals one from the queue of another thread, and
+ * searches it until no subtrees remain.
+ */
+static void *search_subtrees(void *arg)
+{
+    parallel_search *ps = ((worker *) arg)->ps;
+    int thread = ((worker *) arg)->thread;
+
+    int new_bound = INT_MAX;
+    long nodes = 0;
+    int subtree;
+    while ((subtree = take_subtree(ps, thread)) != -1)
+    {
+        // Skip subtrees after one where a solution has been found.
+        if (atomic_load(&ps->solved_subtree) < subtree)
+        {
+            continue;
+        }
+
+        node n = ps->subtrees[subtree];
+        search s = {ps->database, ps->tables ? &ps->tables[thread] : NULL,
+                    ps->ordered, subtree, &ps->solved_subtree, false};
+        int b = depth_first_search(&n, ps->bound - n.num_moves, &s);
+        nodes += s.nodes;
+
+        // A search which stopped early, because of a solution here or in an
+        // earlier subtree, leaves boards in the table which were never fully
+        // searched. They must not cut off the search of an earlier subtree.
+        if (s.table && atomic_load(&ps->solved_subtree) <= subtree)
+        {
+            s.table->iteration++;
+        }
+
+        if (s.solved)
+        {
+            // Keep the solution from the earliest subtree.
+            pthread_mutex_lock(&ps->lock);
+            if (atomic_load(&ps->solved_subtree) == subtree)
+            {
+                ps->solution = n;
+            }
+            pthread_mutex_unlock(&ps->lock);
+        }
+        else if (b != INT_MAX && n.num_moves + b < new_bound)
+        {
+            new_bound = n.num_moves + b;
+        }
+    }
+
+    pthread_mutex_lock(&ps->lock);
+    if (new_bound < ps->new_bound)
+    {
+        ps->new_bound = new_bound;
+    }
+    ps->nodes += nodes;
+    pthread_mutex_unlock(&ps->lock);
+    return NULL;
+}
+
+/*
+ * Removes a subtree index from the queue of the given thread of the parallel
+ * search ps, stealing from the other threads if needed. Returns -1 if there
+ * are no subtrees left.
+ */
+static int take_subtree(parallel_search *ps, int thread)
+{
+    int subtree = -1;
+
+    // First try the front of our own queue.
+    work_queue *q = &ps->queues[thread];
+    pthread_mutex_lock(&q->lock);
+    if (q->front < q->back)
+    {
+        subtree = q->front++;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    // Otherwise steal from the back of another thread's queue.
+    for (int i = 1; subtree == -1 && i < ps->num_threads; i++)
+    {
+        q = &ps->queues[(thread + i) % ps->num_threads];
+        pthread_mutex_lock(&q->lock);
+        if (q->front < q->back)
+        {
+            subtree = --q->back;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+    return subtree;
+}
+
+/*
+ * Starting from the given node, and using heuristics provided by the search s,
+ * performs a depth first search cutting off search branches when the
+ * estimated costs exceed the bound. Once complete, returns the least bound
+ * that could be used for another such search at a greater depth. If at any
+ * point the search reaches the goal state, the search terminates having saved
+ * the solution path in the node n. The search also terminates early if a
+ * solution is found in a subtree preceding the one s is exploring.
+ */
+static int depth_first_search(node *n, int bound, search *s)
+{
+    // The search is made with an explicit stack of frames rather than by
+    // recursion, with bound the bound left for the moves from the current
+    // node.
+    s->depth = 0;
+    enter_node(n, s);
+
+    // The writes to the node's moves may alias the search, so the depth of
+    // the search, its frame and the search's settings are kept here whilst
+    // searching.
+    int depth = 0;
+    frame *f = &s->stack[depth];
+    const pattern_database *database = s->database;
+    bool ordered = s->ordered;
+    atomic_int *solved_subtree = s->solved_subtree;
+    int subtree = s->subtree;
+
+    while (!s->solved)
+    {
+        // Make the moves from the current node in turn until one is within
+        // the bound, so the search goes deeper, or none are left.
+        bool deeper = false;
+        while (f->next < f->num_directions)
+        {
+            // Once the moves are ordered, the first to be cut off gives the
+            // least bound of it and any that follow, without making the move.
+            int k = f->next;
+            if (ordered && 1 + f->heuristics[k] > bound)
+            {
+                if (1 + f->heuristics[k] < f->new_bound)
+                {
+                    f->new_bound = 1 + f->heuristics[k];
+                }
+                f->next = f->num_directions;
+                break;
+            }
+
+            f->next++;
+
+            // Make the move by updating the node n, this also gives the new
+            // heuristic after the move, and add it to the moves list.
+            int direction = f->directions[k];
+            int tile = DIM4_UNPACK(n->board,
+                                   valid_moves[n->empty_index][direction]);
+            move_tile(n, direction, database);
+            n->moves[n->num_moves] = tile;
+            n->num_moves += 1;
+
+            // The new bound.
+            int b = 1 + n->heuristic;
+            if (b <= bound)
+            {
+                // Any bound found below here was found before.
+                if (bound - 1 >= TABLE_MIN_MOVES_LEFT && s->table
+                    && seen_before(s->table, n))
+                {
+                    b = INT_MAX;
+                }
+                else
+                {
+                    deeper = true;
+                    break;
+                }
+            }
+
+            // Take the minimum of the b as the next bound, then undo the move
+            // by moving the tile back from the opposite direction, which also
+            // restores the node's old heuristic, and take it off the moves
+            // list.
+            if (b < f->new_bound)
+            {
+                f->new_bound = b;
+            }
+            move_tile(n, (direction + 2) % 4, database);
+            n->num_moves -= 1;
+        }
+
+        if (deeper)
+        {
+            // Search deeper.
+            s->depth = ++depth;
+            enter_node(n, s);
+            f = &s->stack[depth];
+            bound--;
+            continue;
+        }
+
+        // Every move from this node has been made, so return to the node
+        // before it with the least bound found, if there is one.
+        if (depth == 0)
+        {
+            s->depth = depth;
+            return f->new_bound;
+        }
+        int b = f->new_bound == INT_MAX ? INT_MAX : 1 + f->new_bound;
+        depth--;
+        f = &s->stack[depth];
+        bound++;
+
+        // The puzzle is solved in an earlier subtree, so give up.
+        if (atomic_load_explicit(solved_subtree, memory_order_relaxed)
+            < subtree)
+        {
+            s->depth = depth;
+            return b;
+        }
+
+        // Take the minimum of the b as the next bound and undo the move.
+        if (b < f->new_bound)
+        {
+            f->new_bound = b;
+        }
+        int direction = f->directions[f->next - 1];
+        move_tile(n, (direction + 2) % 4, database);
+        n->num_moves -= 1;
+    }
+
+    // The solution path is left in the node n.
+    s->depth = depth;
+    return 0;
+}
+
+/*
+ * Pushes a frame for the node n onto the stack of the search s, unless n is in
+ * the solved state in which case the search is marked solved.
+ */
+static inline void enter_node(node *n, search *s)
+{
+    // Check for solved state.
+    if (n->board == DIM4_SOLVED_BOARD)
+    {
+        s->solved = true;
+
+        // Record the subtree if it is the earliest with a solution so far.
+        int earliest = atomic_load(s->solved_subtree);
+        while (s->subtree < earliest
+               && !atomic_compare_exchange_weak(s->solved_subtree, &earliest,
+                                                s->subtree))
+        {
+        }
+        return;
+    }
+
+    // The moves from this node, most promising first.
+    s->nodes++;
+    frame *f = &s->stack[s->depth];
+    f->num_directions = order_moves(n, s->ordered, s->database,
+                                    f->directions, f->heuristics);
+    f->next = 0;
+    f->new_bound = INT_MAX;
+}
+
+/*
+ * Fills directions with the directions of valid_moves from which a tile can be
+ * moved into the empty tile's location of the node n, except to undo the
+ * previous move, and returns how many there are. If ordered, they are sorted
+ * by the heuristic after the move, least first, with ties kept in the order
+ * of valid_moves, and those heuristics are saved in heuristics.
+ */
+static inline int order_moves(const node *n, bool ordered,
+                              const pattern_database *database,
+                              uint8_t directions[4], uint8_t heuristics[4])
+{
+    int count = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int move_index = valid_moves[n->empty_index][i];
+
+        // If we have a valid move which doesn't undo the previous move.
+        if (move_index == -1 || (n->num_moves > 0
+                                 && DIM4_UNPACK(n->board, move_index)
+                                    == n->moves[n->num_moves - 1]))
+        {
+            continue;
+        }
+
+        int heuristic = 0;
+        if (ordered)
+        {
+            heuristic = heuristic_after_move(n, i, database);
+        }
+
+        // Insert the move after any with the same heuristic.
+        int j = count;
+        while (j > 0 && heuristics[j - 1] > heuristic)
+        {
+            directions[j] = directions[j - 1];
+            heuristics[j] = heuristics[j - 1];
+            j--;
+        }
+        directions[j] = i;
+        heuristics[j] = heuristic;
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Allocates each of the given number of transposition tables with as many
+ * entries as fit in size bytes. Returns false upon an error.
+ */
+static bool init_transposition_tables(transposition_table tables[],
+                                      int num_tables, size_t size)
+{
+    // The number of entries is a power of two so that a hash is reduced to an
+    // index with a mask.
+    uint64_t num_entries = 1;
+    while (2 * num_entries * sizeof(table_entry) <= size)
+    {
+        num_entries *= 2;
+    }
+    for (int i = 0; i < num_tables; i++)
+    {
+        tables[i].entries = calloc(num_entries, sizeof(table_entry));
+        if (!tables[i].entries)
+        {
+            free_transposition_tables(tables, i);
+            return false;
+        }
+        tables[i].mask = num_entries - 1;
+        tables[i].iteration = 0;
+    }
+    return true;
+}
+
+/*
+ * Frees the entries of the given number of transposition tables.
+ */
+static void free_transposition_tables(transposition_table tables[],
+                                      int num_tables)
+{
+    for (int i = 0; i < num_tables; i++)
+    {
+        free(tables[i].entries);
+    }
+}
+
+/*
+ * Returns true if the board of the node n has already been reached with no
+ * more moves during the current iteration of the search using the table, in
+ * which case nothing new can be found below it. Otherwise records the board
+ * and returns false.
+ */
+static bool seen_before(transposition_table *table, const node *n)
+{
+    table_entry *entry = &table->entries[n->hash & table->mask];
+    if (entry->board == n->board && entry->iteration == table->iteration)
+    {
+        if (entry->num_moves <= n->num_moves)
+        {
+            return true;
+        }
+        entry->num_moves = n->num_moves;
+        return false;
+    }
+
+    // Always replace an entry for a different board, the most recent boards
+    // being the most likely to be reached again.
+    entry->board = n->board;
+    entry->iteration = table->iteration;
+    entry->num_moves = n->num_moves;
+    return false;
+}
+
+/*
+ * Returns the next of a sequence of pseudorandom numbers, splitmix64, from the
+ * given state.
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Fills in the lookup tables used to make moves on packed boards, and those
+ * shared by the patterns of every partition. Called once, see tables_once.
+ */
+static void init_tables(void)
+{
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            // Unsigned arithmetic wraps around so these deltas also work
+            // when they are 'negative'.
+            int move_index = valid_moves[i][j];
+            board_deltas[i][j] = move_index == -1 ? 0 :
+                                 DIM4_PACK(1, i) - DIM4_PACK(1, move_index);
+        }
+        position_deltas[i] = DIM4_PACK(1, i) - DIM4_PACK(1, 0);
+    }
+
+    for (int j = 0; j < DIM4_NUM_TILES; j++)
+    {
+        reflected_location[j] = DIM4 * j - ((DIM4_NUM_TILES - 1) * (j / DIM4));
+        distance_of_tile[0][j] = 0;
+        for (int tile = 1; tile < DIM4_NUM_TILES; tile++)
+        {
+            distance_of_tile[tile][j] = manhattan_distance(tile, j);
+        }
+    }
+
+    // The hashes are repeatable from one run to the next.
+    uint64_t state = 0;
+    for (int tile = 0; tile < DIM4_NUM_TILES; tile++)
+    {
+        for (int j = 0; j < DIM4_NUM_TILES; j++)
+        {
+            zobrist[tile][j] = tile == 0 ? 0 : next_random(&state);
+        }
+    }
+
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            int move_index = valid_moves[i][j];
+            if (move_index == -1)
+            {
+                continue;
+            }
+            fill_passed_locations(passed_locations[i][j], move_index, i,
+                                  false);
+            fill_passed_locations(reflected_passed_locations[i][j], move_index,
+                                  i, true);
+        }
+    }
+}
+
+/*
+ * Fills in the lookup tables of the table used to incrementally update the
+ * indices of the patterns of its partition.
+ */
+static void init_pattern_tables(pattern_table *table)
+{
+    // The order of each tile within its pattern and reflected pattern.
+    int order_of_tile[DIM4_NUM_TILES];
+    int reflected_order_of_tile[DIM4_NUM_TILES];
+
+    // The empty tile belongs to no pattern.
+    int *pattern_of_tile = table->pattern_of_tile;
+    int *reflected_pattern_of_tile = table->reflected_pattern_of_tile;
+    int *compact_place_of_tile = table->compact_place_of_tile;
+    int *reflected_compact_place_of_tile
+        = table->reflected_compact_place_of_tile;
+    pattern_of_tile[0] = -1;
+    reflected_pattern_of_tile[0] = -1;
+    const tile_pattern *patterns = table->partition->patterns;
+    for (int i = 0; i < table->partition->num_patterns; i++)
+    {
+        // The sparse place values of the last tile of a large pattern would
+        // overflow an int but such patterns are only saved compactly.
+        long long place = 1;
+        for (int j = 0; j < patterns[i].num_tiles; j++)
+        {
+            pattern_of_tile[patterns[i].tiles[j]] = i;
+            table->place_of_tile[patterns[i].tiles[j]] = place;
+            reflected_pattern_of_tile[patterns[i].reflected_tiles[j]] = i;
+            table->reflected_place_of_tile[patterns[i].reflected_tiles[j]]
+                = place;
+            place *= DIM4_NUM_TILES;
+        }
+
+        // In the compact layout the first tile is the most significant digit,
+        // see compact_index in dim4.h.
+        int compact_place = 1;
+        for (int j = patterns[i].num_tiles - 1; j >= 0; j--)
+        {
+            order_of_tile[patterns[i].tiles[j]] = j;
+            compact_place_of_tile[patterns[i].tiles[j]] = compact_place;
+            reflected_order_of_tile[patterns[i].reflected_tiles[j]] = j;
+            reflected_compact_place_of_tile[patterns[i].reflected_tiles[j]]
+                = compact_place;
+            compact_place *= DIM4_NUM_TILES - j;
+        }
+    }
+
+    for (int t = 0; t < DIM4_NUM_TILES; t++)
+    {
+        for (int u = 0; u < DIM4_NUM_TILES; u++)
+        {
+            table->crossing_change[t][u] = 0;
+            if (t != u && t != 0 && pattern_of_tile[t] == pattern_of_tile[u])
+            {
+                table->crossing_change[t][u]
+                    = order_of_tile[u] < order_of_tile[t]
+                      ? -compact_place_of_tile[t]
+                      : compact_place_of_tile[u];
+            }
+            table->reflected_crossing_change[t][u] = 0;
+            if (t != u && t != 0
+                && reflected_pattern_of_tile[t] == reflected_pattern_of_tile[u])
+            {
+                table->reflected_crossing_change[t][u]
+                    = reflected_order_of_tile[u] < reflected_order_of_tile[t]
+                      ? -reflected_compact_place_of_tile[t]
+                      : reflected_compact_place_of_tile[u];
+            }
+        }
+    }
+}
+
+/*
+ * Fills passed with the board indices of the locations strictly between the
+ * locations from and to, in the order used for the compact index of a pattern
+ * or if reflected a reflected pattern. If there are none, uses from instead.
+ */
+static void fill_passed_locations(int passed[3], int from, int to,
+                                  bool reflected)
+{
+    if (reflected)
+    {
+        from = reflected_location[from];
+        to = reflected_location[to];
+    }
+    int low = from < to ? from : to;
+    int high = from < to ? to : from;
+    for (int k = 0; k < 3; k++)
+    {
+        int location = low + 1 + k < high ? low + 1 + k : from;
+        passed[k] = reflected ? reflected_location[location] : location;
+    }
+}
+
+/*
+ * Fills in the tables of the walking distance and of linear conflicts, and
+ * the database which uses them. Called once, see walking_once.
+ */
+static void init_walking_distance(void)
+{
+    // Every state, sorted by its code so that it may be found by bsearch.
+    int counts[DIM4][DIM4] = {{0}};
+    int num_states = 0;
+    for (int empty_row = 0; empty_row < DIM4; empty_row++)
+    {
+        num_states = add_walking_states(counts, 0, empty_row, num_states);
+    }
+    qsort(walking_states, num_states, sizeof(uint64_t), compare_codes);
+
+    // A breadth first search from the solved state, in which each row holds
+    // its own tiles and the empty tile is in the bottom row.
+    for (int r = 0; r < DIM4; r++)
+    {
+        counts[r][r] = r == DIM4 - 1 ? DIM4 - 1 : DIM4;
+    }
+    static uint16_t queue[NUM_WALKING_STATES];
+    memset(walking_distances, UINT8_MAX, sizeof(walking_distances));
+    uint64_t solved = walking_code(counts, DIM4 - 1);
+    queue[0] = (uint64_t *) bsearch(&solved, walking_states, num_states,
+                                    sizeof(uint64_t), compare_codes)
+               - walking_states;
+    walking_distances[queue[0]] = 0;
+    int head = 0;
+    int tail = 1;
+    while (head < tail)
+    {
+        int state = queue[head++];
+        uint64_t code = walking_states[state];
+        int empty_row = code >> 3 * DIM4_NUM_TILES;
+        for (int r = 0; r < DIM4; r++)
+        {
+            for (int g = 0; g < DIM4; g++)
+            {
+                counts[r][g] = (code >> 3 * (DIM4 * r + g)) & 7;
+            }
+        }
+
+        // A tile moves into the empty tile's row from the row above it, or
+        // below it, and the empty tile takes its place.
+        for (int j = 0; j < 2; j++)
+        {
+            int row = j == 0 ? empty_row - 1 : empty_row + 1;
+            for (int g = 0; g < DIM4; g++)
+            {
+                walking_links[state][j][g] = state;
+                if (row < 0 || row >= DIM4 || counts[row][g] == 0)
+                {
+                    continue;
+                }
+                counts[row][g]--;
+                counts[empty_row][g]++;
+                uint64_t next_code = walking_code(counts, row);
+                int next = (uint64_t *) bsearch(&next_code, walking_states,
+                                                num_states, sizeof(uint64_t),
+                                                compare_codes)
+                           - walking_states;
+                counts[row][g]++;
+                counts[empty_row][g]--;
+
+                walking_links[state][j][g] = next;
+                if (walking_distances[next] == UINT8_MAX)
+                {
+                    walking_distances[next] = walking_distances[state] + 1;
+                    queue[tail++] = next;
+                }
+            }
+        }
+    }
+
+    // The tiles of a line whose goal is in that line form the digits of its
+    // code, in base 5 with 0 for any other tile, and all but those in a
+    // longest increasing sequence of them must step out of the line and back.
+    for (int code = 0; code < NUM_LINE_CODES; code++)
+    {
+        int longest[DIM4];
+        int longest_run = 0;
+        int num_tiles = 0;
+        for (int k = 0, digits = code; k < DIM4; k++, digits /= 5)
+        {
+            // The digits are read from the last location of the line.
+            int digit = digits % 5;
+            longest[k] = 0;
+            if (digit == 0)
+            {
+                continue;
+            }
+            num_tiles++;
+            longest[k] = 1;
+            for (int m = 0, others = code; m < k; m++, others /= 5)
+            {
+                int other = others % 5;
+                if (other > digit && longest[m] + 1 > longest[k])
+                {
+                    longest[k] = longest[m] + 1;
+                }
+            }
+            if (longest[k] > longest_run)
+            {
+                longest_run = longest[k];
+            }
+        }
+        linear_conflicts[code] = 2 * (num_tiles - longest_run);
+    }
+    for (int line = 0; line < DIM4; line++)
+    {
+        line_digit[0][line][0] = 0;
+        line_digit[1][line][0] = 0;
+        for (int tile = 1; tile < DIM4_NUM_TILES; tile++)
+        {
+            int row = (tile - 1) / DIM4;
+            int column = (tile - 1) % DIM4;
+            line_digit[0][line][tile] = row == line ? column + 1 : 0;
+            line_digit[1][line][tile] = column == line ? row + 1 : 0;
+        }
+    }
+
+    walking_database.num_tables = 0;
+    walking_database.walking_distance = true;
+}
+
+/*
+ * Appends to walking_states, which already holds num_states states, those
+ * states of the walking distance with the given counts before the given cell,
+ * numbering the cells of counts row by row, and the given row of the empty
+ * tile. Returns the new number of states.
+ */
+static int add_walking_states(int counts[DIM4][DIM4], int cell, int empty_row,
+                              int num_states)
+{
+    if (cell == DIM4_NUM_TILES)
+    {
+        walking_states[num_states] = walking_code(counts, empty_row);
+        return num_states + 1;
+    }
+
+    // Each row holds four tiles, less the empty tile, and there are four
+    // tiles of each goal row, less the empty tile's place in the last row.
+    int r = cell / DIM4;
+    int g = cell % DIM4;
+    int row_left = r == empty_row ? DIM4 - 1 : DIM4;
+    int goal_left = g == DIM4 - 1 ? DIM4 - 1 : DIM4;
+    for (int k = 0; k < g; k++)
+    {
+        row_left -= counts[r][k];
+    }
+    for (int k = 0; k < r; k++)
+    {
+        goal_left -= counts[k][g];
+    }
+
+    // The last cell of a row or of a goal row has no choice.
+    int low = 0;
+    int high = row_left < goal_left ? row_left : goal_left;
+    if (g == DIM4 - 1 || r == DIM4 - 1)
+    {
+        low = g == DIM4 - 1 ? row_left : goal_left;
+        if (r == DIM4 - 1 && g == DIM4 - 1 && row_left != goal_left)
+        {
+            return num_states;
+        }
+    }
+    for (int count = low; count <= high; count++)
+    {
+        counts[r][g] = count;
+        num_states = add_walking_states(counts, cell + 1, empty_row,
+                                        num_states);
+    }
+    counts[r][g] = 0;
+    return num_states;
+}
+
+/*
+ * Returns the code of the state of the walking distance in which counts[r][g]
+ * tiles of goal row g are in row r and the empty tile is in empty_row. The
+ * codes increase with the empty tile's row.
+ */
+static uint64_t walking_code(int counts[DIM4][DIM4], int empty_row)
+{
+    uint64_t code = (uint64_t) empty_row << 3 * DIM4_NUM_TILES;
+    for (int r = 0; r < DIM4; r++)
+    {
+        for (int g = 0; g < DIM4; g++)
+        {
+            code |= (uint64_t) counts[r][g] << 3 * (DIM4 * r + g);
+        }
+    }
+    return code;
 }
-node;
-
-// A global to track when the puzzle becomes solved to help back out of the
-// recursive search.
-static bool solved;
 
 /*
- * Starting from the given node, and using heuristics provided by dim4_array,
- * performs a depth first search cutting off search branches when the
- * estimated costs exceed the bound. Once complete, returns the least bound
- * that could be used for another such search at a greater depth. If at any
- * point the search reaches the goal state, the search terminates having saved
- * the solution path in the node n.
+ * Compares two codes of states of the walking distance for qsort and bsearch.
  */
-int depth_first_search(node *n, int bound, uint8_t *dim4_array);
+static int compare_codes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
 
 /*
- * Loads heuristic values from disk into an array and returns a pointer to that
- * array.
+ * Returns the state of the walking distance of the rows of the board given by
+ * its packed positions, or if reflected of its columns.
  */
-uint8_t *load_dim4_heuristics(void);
+static int walking_state(uint64_t positions, bool reflected)
+{
+    int counts[DIM4][DIM4] = {{0}};
+    for (int tile = 1; tile < DIM4_NUM_TILES; tile++)
+    {
+        int location = DIM4_UNPACK(positions, tile);
+        if (reflected)
+        {
+            counts[location % DIM4][(tile - 1) % DIM4]++;
+        }
+        else
+        {
+            counts[location / DIM4][(tile - 1) / DIM4]++;
+        }
+    }
+    int empty = DIM4_UNPACK(positions, 0);
+    uint64_t code = walking_code(counts, reflected ? empty % DIM4
+                                                   : empty / DIM4);
+    return (uint64_t *) bsearch(&code, walking_states, NUM_WALKING_STATES,
+                                sizeof(uint64_t), compare_codes)
+           - walking_states;
+}
 
 /*
- * For a given board of tiles, retrieves the heuristic for that board from the
- * array of heuristic values.
+ * Returns the heuristic used without a database for the node n after sliding
+ * the tile from the given direction of valid_moves into the empty tile's
+ * location, without making the move. Unless after is NULL, also saves the
+ * states of the walking distance, the Manhattan distance and the linear
+ * conflicts after the move in the node after, which may be n itself.
  */
-int get_heurisitic(uint8_t *dim4_array, int board[DIM4_NUM_TILES]);
+static inline int walking_distance_after_move(const node *n, int direction,
+                                              node *after)
+{
+    int to = n->empty_index;
+    int move_index = valid_moves[to][direction];
+    int tile = DIM4_UNPACK(n->board, move_index);
+    uint64_t board = n->board + tile * board_deltas[to][direction];
+
+    // A vertical move changes only the rows, the tile leaving one row for
+    // another, and a horizontal move only the columns. The order of the tiles
+    // within the other line is unchanged.
+    int rows = n->index[0][0];
+    int columns = n->reflected_index[0][0];
+    bool column = direction % 2 == 1;
+    int conflicts = n->conflicts;
+    if (!column)
+    {
+        rows = walking_links[rows][direction / 2][(tile - 1) / DIM4];
+        conflicts += line_conflicts(board, to / DIM4, false)
+                     + line_conflicts(board, move_index / DIM4, false)
+                     - line_conflicts(n->board, to / DIM4, false)
+                     - line_conflicts(n->board, move_index / DIM4, false);
+    }
+    else
+    {
+        columns = walking_links[columns][direction == 1][(tile - 1) % DIM4];
+        conflicts += line_conflicts(board, to % DIM4, true)
+                     + line_conflicts(board, move_index % DIM4, true)
+                     - line_conflicts(n->board, to % DIM4, true)
+                     - line_conflicts(n->board, move_index % DIM4, true);
+    }
+    int distance = n->distance + distance_of_tile[tile][to]
+                   - distance_of_tile[tile][move_index];
+    int walking = walking_distances[rows] + walking_distances[columns];
+
+    if (after)
+    {
+        after->index[0][0] = rows;
+        after->value[0][0] = walking_distances[rows];
+        after->sum[0] = after->value[0][0];
+        after->reflected_index[0][0] = columns;
+        after->reflected_value[0][0] = walking_distances[columns];
+        after->reflected_sum[0] = after->reflected_value[0][0];
+        after->distance = distance;
+        after->conflicts = conflicts;
+    }
+    return walking > distance + conflicts ? walking : distance + conflicts;
+}
 
 /*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
+ * Returns the linear conflicts of the given row of the packed board, or if
+ * column is true of the given column.
  */
-int arr_index(int board[DIM4_NUM_TILES], tile_pattern pattern, bool reflected);
+static inline int line_conflicts(uint64_t board, int line, bool column)
+{
+    const int *digit = line_digit[column][line];
+    int first = column ? line : DIM4 * line;
+    int step = column ? DIM4 : 1;
+    int code = 0;
+    for (int k = 0; k < DIM4; k++)
+    {
+        code = 5 * code + digit[DIM4_UNPACK(board, first + k * step)];
+    }
+    return linear_conflicts[code];
+}
 
 /*
- * Given an offset so that we can identify a the 4x4 lower right corner of the
- * puzzle, and given an array of heuristic values, calls successive
- * heuristic-guided depth-first searches until an optimal solution is found to
- * arrange the 4x4 tiles correctly. Returns true on success. Otherwise returns
- * false.
+ * Sets the tile positions, hash, pattern indices, heuristic values and sums
+ * held in the node n from scratch using its board.
  */
-bool dim4_solver(int board_offset, uint8_t *dim4_array)
+static void init_node_heuristic(node *n, const pattern_database *database)
 {
-    // Setup a root node.
-    node *root = malloc(sizeof(node));
-    if (!root)
+    n->positions = 0;
+    n->hash = 0;
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
     {
-        return false;
+        n->positions += DIM4_PACK(i, DIM4_UNPACK(n->board, i));
+        n->hash ^= zobrist[DIM4_UNPACK(n->board, i)][i];
     }
 
-    // Read in the 4x4 lower right corner of the puzzle board and adjust the
-    // tile numbers to be in the range 1-15.
-    int i = 0;
-    for (int row = board_offset; row < p.dim; row++)
+    n->distance = 0;
+    if (database->packed || database->walking_distance)
     {
-        for (int col = board_offset; col < p.dim; col++)
+        for (int i = 1; i < DIM4_NUM_TILES; i++)
         {
-            if (p.board[row][col] == 0)
-            {
-                root->empty_index = i;
-                root->board[i++] = 0;
-            }
-            else
-            {
-                int pos = p.board[row][col] - 1;
-                int adjusted_row = (pos / p.dim) - board_offset;
-                int adjusted_col = (pos % p.dim) - board_offset;
-                root->board[i++] = (adjusted_row * DIM4) + adjusted_col + 1;
-            }
+            n->distance += distance_of_tile[i][DIM4_UNPACK(n->positions, i)];
         }
     }
-    root->num_moves = 0;
-    root->heuristic = get_heurisitic(dim4_array, root->board);
 
-    // Use the heuristic as the initial bound for successive A* depth-first
-    // searches.
-    solved = false;
-    int bound = root->heuristic;
-    while (!solved)
+    if (database->walking_distance)
     {
-        bound = depth_first_search(root, bound, dim4_array);
-        if (bound == INT_MAX)
+        int rows = walking_state(n->positions, false);
+        int columns = walking_state(n->positions, true);
+        n->index[0][0] = rows;
+        n->value[0][0] = walking_distances[rows];
+        n->sum[0] = n->value[0][0];
+        n->reflected_index[0][0] = columns;
+        n->reflected_value[0][0] = walking_distances[columns];
+        n->reflected_sum[0] = n->reflected_value[0][0];
+        n->conflicts = 0;
+        for (int line = 0; line < DIM4; line++)
         {
-            return false;
+            n->conflicts += line_conflicts(n->board, line, false)
+                            + line_conflicts(n->board, line, true);
         }
+        int walking = n->sum[0] + n->reflected_sum[0];
+        n->heuristic = walking > n->distance + n->conflicts
+                       ? walking : n->distance + n->conflicts;
+        return;
     }
 
-    // The solution's tile moves are for tiles from 1 to 15. First locate the
-    // corresponding tile in the original puzzle according to the offset, then
-    // make the move for that tile.
-    for (int i = 0; i < root->num_moves; i++)
+    for (int t = 0; t < database->num_tables; t++)
     {
-        int adjusted_row = (root->moves[i] - 1) / DIM4;
-        int adjusted_col = (root->moves[i] - 1) % DIM4;
-        int tile = (adjusted_row + board_offset) * p.dim + (adjusted_col + board_offset) + 1;
-        slide_tile(tile);
-    }
+        const pattern_table *table = &database->tables[t];
+        const tile_pattern *patterns = table->partition->patterns;
+        n->sum[t] = 0;
+        n->reflected_sum[t] = 0;
+        for (int i = 0; i < table->partition->num_patterns; i++)
+        {
+            n->index[t][i] = pattern_index(n->positions, &patterns[i], false,
+                                           table->layout);
+            n->value[t][i] = lookup_value(table, n->index[t][i]);
+            n->sum[t] += n->value[t][i];
 
-    free(root);
-    return true;
+            n->reflected_index[t][i] = pattern_index(n->positions,
+                                                     &patterns[i], true,
+                                                     table->layout);
+            n->reflected_value[t][i] = lookup_value(table,
+                                                    n->reflected_index[t][i]);
+            n->reflected_sum[t] += n->reflected_value[t][i];
+        }
+    }
+    n->heuristic = combine_sums(database, database->num_tables, n->sum,
+                                n->reflected_sum, n->distance, n->board,
+                                n->empty_index);
 }
 
 /*
- * Starting from the given node, and using heuristics provided by dim4_array,
- * performs a depth first search cutting off search branches when the
- * estimated costs exceed the bound. Once complete, returns the least bound
- * that could be used for another such search at a greater depth. If at any
- * point the search reaches the goal state, the search terminates having saved
- * the solution path in the node n.
+ * Slides the tile from the given direction of valid_moves into the empty
+ * tile's location, updating the board, the pattern indices and the heuristic
+ * of the node n. Only the pattern and reflected pattern of each table
+ * containing the moved tile are looked up again.
  */
-int depth_first_search(node *n, int bound, uint8_t *dim4_array)
+static void move_tile(node *n, int direction,
+                      const pattern_database *database)
 {
-    // Check for solved state.
-    if (n->heuristic == 0)
+    int to = n->empty_index;
+    int move_index = valid_moves[to][direction];
+    int tile = DIM4_UNPACK(n->board, move_index);
+    if (database->walking_distance)
     {
-        solved = true;
-        return 0;
+        n->heuristic = walking_distance_after_move(n, direction, n);
     }
 
-    // Look for a new bound to return.
-    int new_bound = INT_MAX;
+    n->board += tile * board_deltas[to][direction];
+    n->positions += (uint64_t) (to - move_index) * position_deltas[tile];
+    n->hash ^= zobrist[tile][move_index] ^ zobrist[tile][to];
+    n->empty_index = move_index;
+    if (database->packed)
+    {
+        n->distance += distance_of_tile[tile][to]
+                       - distance_of_tile[tile][move_index];
+    }
+    if (database->walking_distance)
+    {
+        return;
+    }
 
-    // For each neighbour node.
-    for (int i = 0; i < 4; i++)
+    // Most databases have a single table, and given that as a constant the
+    // compiler can do away with the loops over the tables.
+    if (database->num_tables == 1)
     {
-        int move_index = valid_moves[n->empty_index][i];
+        update_tables(n, tile, to, direction, database, 1);
+    }
+    else
+    {
+        update_tables(n, tile, to, direction, database, database->num_tables);
+    }
+}
 
-        // If we have a valid move.
-        if (move_index != -1)
+/*
+ * Updates the pattern indices, heuristic values, sums and heuristic of the
+ * first num_tables tables of the database, all of them, for the node n after
+ * the given tile has moved from the given direction of valid_moves into the
+ * location to.
+ */
+static inline void update_tables(node *n, int tile, int to, int direction,
+                                 const pattern_database *database,
+                                 int num_tables)
+{
+    int move_index = valid_moves[to][direction];
+    for (int t = 0; t < num_tables; t++)
+    {
+        // In the sparse layout the tile's digit in its pattern index changes
+        // from move_index to to. In the compact layout other digits may
+        // change too.
+        const pattern_table *table = &database->tables[t];
+        int i = table->pattern_of_tile[tile];
+        if (table->layout == SPARSE_LAYOUT)
+        {
+            n->index[t][i] += (to - move_index) * table->place_of_tile[tile];
+        }
+        else
         {
-            int tile = n->board[move_index];
+            n->index[t][i] += compact_change(table, n->board, tile, to,
+                                             direction, false);
+        }
+        n->sum[t] -= n->value[t][i];
+        n->value[t][i] = lookup_value(table, n->index[t][i]);
+        n->sum[t] += n->value[t][i];
 
-            if (tile != n->moves[n->num_moves - 1])
-            {
-                int old_empty_index = n->empty_index;
+        // Likewise for the reflected pattern but using reflected locations.
+        i = table->reflected_pattern_of_tile[tile];
+        if (table->layout == SPARSE_LAYOUT)
+        {
+            n->reflected_index[t][i] += (reflected_location[to]
+                                         - reflected_location[move_index])
+                                        * table->reflected_place_of_tile[tile];
+        }
+        else
+        {
+            n->reflected_index[t][i] += compact_change(table, n->board, tile,
+                                                       to, direction, true);
+        }
+        n->reflected_sum[t] -= n->reflected_value[t][i];
+        n->reflected_value[t][i] = lookup_value(table,
+                                                n->reflected_index[t][i]);
+        n->reflected_sum[t] += n->reflected_value[t][i];
+    }
 
-                // Track the old heuristic value.
-                int old_heuristic = n->heuristic;
+    n->heuristic = combine_sums(database, num_tables, n->sum,
+                                n->reflected_sum, n->distance, n->board,
+                                n->empty_index);
+}
 
-                // Make the move by updating the node n.
-                n->board[n->empty_index] = tile;
-                n->board[move_index] = 0;
-                n->empty_index = move_index;
+/*
+ * Returns the heuristic of the node n after sliding the tile from the given
+ * direction of valid_moves into the empty tile's location, without making the
+ * move. See move_tile.
+ */
+static inline int heuristic_after_move(const node *n, int direction,
+                                       const pattern_database *database)
+{
+    if (database->walking_distance)
+    {
+        return walking_distance_after_move(n, direction, NULL);
+    }
+    if (database->num_tables == 1)
+    {
+        return tables_after_move(n, direction, database, 1);
+    }
+    return tables_after_move(n, direction, database, database->num_tables);
+}
 
-                // Get the new heuristic after the move.
-                n->heuristic = get_heurisitic(dim4_array, n->board);
+/*
+ * Returns the heuristic of the node n, using the first num_tables tables of
+ * the database, all of them, after sliding the tile from the given direction
+ * of valid_moves into the empty tile's location, without making the move.
+ */
+static inline int tables_after_move(const node *n, int direction,
+                                    const pattern_database *database,
+                                    int num_tables)
+{
+    int to = n->empty_index;
+    int move_index = valid_moves[to][direction];
+    int tile = DIM4_UNPACK(n->board, move_index);
 
-                // Add the move to the moves list.
-                n->moves[n->num_moves] = tile;
-                n->num_moves += 1;
+    int sum[MAX_PARTITIONS];
+    int reflected_sum[MAX_PARTITIONS];
+    for (int t = 0; t < num_tables; t++)
+    {
+        // The locations a tile passes over are unchanged by its move, so the
+        // compact index changes the same with the board before the move.
+        const pattern_table *table = &database->tables[t];
+        int i = table->pattern_of_tile[tile];
+        int index = n->index[t][i];
+        if (table->layout == SPARSE_LAYOUT)
+        {
+            index += (to - move_index) * table->place_of_tile[tile];
+        }
+        else
+        {
+            index += compact_change(table, n->board, tile, to, direction,
+                                    false);
+        }
+        sum[t] = n->sum[t] - n->value[t][i] + lookup_value(table, index);
 
-                // The new bound.
-                int b = 1 + n->heuristic;
+        i = table->reflected_pattern_of_tile[tile];
+        index = n->reflected_index[t][i];
+        if (table->layout == SPARSE_LAYOUT)
+        {
+            index += (reflected_location[to] - reflected_location[move_index])
+                     * table->reflected_place_of_tile[tile];
+        }
+        else
+        {
+            index += compact_change(table, n->board, tile, to, direction,
+                                    true);
+        }
+        reflected_sum[t] = n->reflected_sum[t] - n->reflected_value[t][i]
+                           + lookup_value(table, index);
+    }
 
-                if (b <= bound)
-                {
-                    // Search deeper.
-                    b = 1 + depth_first_search(n, bound - 1, dim4_array);
-                }
+    int distance = n->distance;
+    if (database->packed)
+    {
+        distance += distance_of_tile[tile][to]
+                    - distance_of_tile[tile][move_index];
+    }
+    return combine_sums(database, num_tables, sum, reflected_sum, distance,
+                        n->board + tile * board_deltas[to][direction],
+                        move_index);
+}
 
-                // The puzzle is solved so back out of recursion.
-                if (solved)
-                {
-                    return b;
-                }
+/*
+ * Returns the heuristic of a board given the sums of the heuristic values of
+ * the patterns and reflected patterns of the first num_tables tables of the
+ * database, all of them, and the Manhattan distance if any table is packed.
+ * This is the largest over the tables of the larger of the two sums and, if
+ * the empty tile at empty_index is in its solved location, the sums for the
+ * dual of the board, see dual_sum.
+ */
+static inline int combine_sums(const pattern_database *database,
+                               int num_tables, const int sum[],
+                               const int reflected_sum[], int distance,
+                               uint64_t board, int empty_index)
+{
+    bool dual = empty_index == DIM4_NUM_TILES - 1;
+    uint64_t positions = dual ? dual_positions(board) : 0;
+    int heuristic = 0;
+    for (int t = 0; t < num_tables; t++)
+    {
+        const pattern_table *table = &database->tables[t];
+        int best = sum[t] > reflected_sum[t] ? sum[t] : reflected_sum[t];
+        if (dual)
+        {
+            int dual_best = dual_sum(positions, table);
+            best = dual_best > best ? dual_best : best;
+        }
+        if (table->packed)
+        {
+            best += distance;
+        }
+        heuristic = best > heuristic ? best : heuristic;
+    }
+    return heuristic;
+}
 
-                // Take the minimum of the b as the next bound.
-                if (b < new_bound)
-                {
-                    new_bound = b;
-                }
+/*
+ * Returns the change in the compact index of the pattern of the table, or if
+ * reflected the reflected pattern, containing tile when it has moved from the
+ * given direction of valid_moves to the location to on the given board.
+ * Besides the tile's own digit, only the digits of tiles of the same pattern
+ * it passes over change, so horizontal moves, (vertical in the reflected
+ * board), change only the one digit.
+ */
+static inline int compact_change(const pattern_table *table, uint64_t board,
+                                 int tile, int to, int direction,
+                                 bool reflected)
+{
+    int from = valid_moves[to][direction];
+    int place = table->compact_place_of_tile[tile];
+    const int *passed = passed_locations[to][direction];
+    const int (*crossing)[DIM4_NUM_TILES] = table->crossing_change;
+    if (reflected)
+    {
+        place = table->reflected_compact_place_of_tile[tile];
+        passed = reflected_passed_locations[to][direction];
+        crossing = table->reflected_crossing_change;
+        from = reflected_location[from];
+        to = reflected_location[to];
+    }
 
-                // Undo the move in preparation for the next neighbour.
-                n->board[move_index] = tile;
-                n->board[old_empty_index] = 0;
-                n->empty_index = old_empty_index;
+    // Vertical moves pass over three locations in the board, horizontal moves
+    // three locations in the reflected board.
+    if ((direction % 2 == 0) == reflected)
+    {
+        return (to - from) * place;
+    }
 
-                // Restore the node's old heuristic.
-                n->heuristic = old_heuristic;
+    // Which tiles are passed over is unpredictable so avoid branching on it.
+    int crossed = crossing[tile][DIM4_UNPACK(board, passed[0])]
+                  + crossing[tile][DIM4_UNPACK(board, passed[1])]
+                  + crossing[tile][DIM4_UNPACK(board, passed[2])];
+    return (to - from) * place + (to > from ? crossed : -crossed);
+}
 
-                // Take the move off the moves list.
-                n->num_moves -= 1;
-                n->moves[n->num_moves] = 0;
+/*
+ * Returns the heuristic value at the given index of the table. For a packed
+ * table this excludes the Manhattan distance of the pattern's tiles, which
+ * the node tracks separately.
+ */
+static inline int lookup_value(const pattern_table *table, int index)
+{
+    if (table->packed)
+    {
+        return 2 * packed_value(table->values, index);
+    }
+    return table->values[index];
+}
 
-            }
-        }
+/*
+ * Returns the packed positions of the tiles of the dual of the given packed
+ * board, which must have the empty tile in its solved location.
+ */
+static uint64_t dual_positions(uint64_t board)
+{
+    // The dual of a board swaps the roles of tiles and locations, so it holds
+    // the tile whose solved location is l in the solved location of the tile
+    // found at l. With the empty tile in its solved location both boards
+    // need the same number of moves, but otherwise the dual may need more and
+    // its heuristic could overestimate. The Manhattan distance of the dual is
+    // the same as that of the board.
+    uint64_t positions = DIM4_PACK(DIM4_NUM_TILES - 1, 0);
+    for (int i = 0; i < DIM4_NUM_TILES - 1; i++)
+    {
+        positions += DIM4_PACK(DIM4_UNPACK(board, i) - 1, i + 1);
     }
-    return new_bound;
+    return positions;
 }
 
 /*
- * Loads heuristic values from disk into an array and returns a pointer to that
- * array.
+ * Returns the larger of the sums of the heuristic values of the patterns and
+ * of the reflected patterns of the table for the dual of a board, given the
+ * dual's packed positions.
  */
-uint8_t *load_dim4_heuristics(void)
+static int dual_sum(uint64_t positions, const pattern_table *table)
 {
-    uint8_t *dim4_array = malloc(TOTAL_STATES);
-    if (!dim4_array)
+    int sum = 0;
+    int reflected_sum = 0;
+    const tile_pattern *patterns = table->partition->patterns;
+    for (int i = 0; i < table->partition->num_patterns; i++)
+    {
+        sum += lookup_value(table, pattern_index(positions, &patterns[i],
+                                                 false, table->layout));
+        reflected_sum += lookup_value(table,
+                                      pattern_index(positions, &patterns[i],
+                                                    true, table->layout));
+    }
+    return sum > reflected_sum ? sum : reflected_sum;
+}
+
+/*
+ * Reads the partitions declared in DIM4_PARTITIONS_FILE and maps the
+ * heuristic values of each of them on disk into memory, reading their layout
+ * and packing from the header of the file. Partitions whose file is missing,
+ * damaged or for different patterns are left out. Returns the database, or
+ * NULL if no partition could be loaded or upon any error. See map_file.h for
+ * how the mapping may be configured.
+ */
+pattern_database *load_dim4_heuristics(void)
+{
+    partition partitions[MAX_PARTITIONS];
+    int num_partitions = read_dim4_partitions(DIM4_PARTITIONS_FILE,
+                                              partitions, NULL);
+    if (num_partitions == -1)
     {
         return NULL;
     }
+    return load_dim4_partitions(partitions, num_partitions);
+}
 
-    // Load heuristics data.
-    FILE *fp = fopen(DIM4_HEURISTICS_FILE, "rb");
-    if (!fp)
+/*
+ * Maps the heuristic values of each of the given partitions, of which there
+ * may be at most MAX_PARTITIONS, into memory as for load_dim4_heuristics.
+ * Returns the database, or NULL if no partition could be loaded or upon any
+ * error.
+ */
+pattern_database *load_dim4_partitions(const partition partitions[],
+                                       int num_partitions)
+{
+    if (num_partitions > MAX_PARTITIONS)
+    {
+        return NULL;
+    }
+    pattern_database *database = malloc(sizeof(pattern_database));
+    if (!database)
     {
-        if (dim4_array)
-        {
-            free(dim4_array);
-        }
         return NULL;
     }
+    database->num_tables = 0;
+    database->packed = false;
+    database->walking_distance = false;
+    pthread_once(&tables_once, init_tables);
 
-    if (fread(dim4_array, TOTAL_STATES, 1, fp) != 1)
+    // The tables refer to the database's own copy of the partitions.
+    memcpy(database->partitions, partitions,
+           num_partitions * sizeof(partition));
+    for (int i = 0; i < num_partitions; i++)
     {
-        if (dim4_array)
+        pattern_table *table = &database->tables[database->num_tables];
+        if (load_table(table, &database->partitions[i]))
         {
-            free(dim4_array);
+            database->packed = database->packed || table->packed;
+            database->num_tables++;
         }
-        fclose(fp);
+    }
+
+    if (database->num_tables == 0)
+    {
+        free(database);
         return NULL;
     }
-    fclose(fp);
-    return dim4_array;
+    return database;
 }
 
 /*
- * For a given board of tiles, retrieves a heuristic for that board from the
- * array of heuristic values.
+ * Maps the heuristic values of the given partition into the table, reading
+ * their layout and packing from the header of the file, and fills in the
+ * table's lookup tables. Returns false upon any error.
  */
-int get_heurisitic(uint8_t *dim4_array, int board[DIM4_NUM_TILES])
+static bool load_table(pattern_table *table, const partition *partition)
 {
-    int index;
-    int heuristic = 0;
-    int reflected_heuristic = 0;
-    // Sum the heuristic values for each pattern.
-    for (int i = 0; i < NUM_PATTERNS; i++)
+    heuristics_header header;
+    table->values = map_heuristics_file(partition->file, DIM4_HEURISTICS,
+                                        map_policy_includes("verify"),
+                                        &header);
+    if (!table->values)
     {
-        // First get the normal heuristic.
-        index = arr_index(board, patterns[i], false);
-        heuristic += dim4_array[index + patterns[i].array_offset];
+        return false;
+    }
 
-        // Now calculate the heuristic for the board reflected about the main
-        // diagonal.
-        index = arr_index(board, patterns[i], true);
-        reflected_heuristic += dim4_array[index + patterns[i].array_offset];
+    // A database generated for different patterns must not be used.
+    table->length = header.length;
+    if (!header_matches_partition(&header, partition))
+    {
+        unmap_heuristics_file(table->values, table->length);
+        return false;
     }
+    table->partition = partition;
+    table->layout = header.layout;
+    table->packed = header.packed;
+    init_pattern_tables(table);
+    return true;
+}
 
-    // Take the maximum of the two heuristics.
-    if (heuristic < reflected_heuristic)
+/*
+ * Releases a database returned by load_dim4_heuristics or
+ * load_dim4_partitions.
+ */
+void unload_dim4_heuristics(pattern_database *database)
+{
+    for (int t = 0; t < database->num_tables; t++)
     {
-        heuristic = reflected_heuristic;
+        unmap_heuristics_file(database->tables[t].values,
+                              database->tables[t].length);
     }
+    free(database);
+}
 
-    return heuristic;
+/*
+ * Returns the database loaded by load_dim4_heuristics which is shared by
+ * every caller, loading it on the first call, or returns NULL upon any error
+ * in which case a later call tries again. It is never released.
+ */
+const pattern_database *load_shared_dim4_heuristics(void)
+{
+    pthread_mutex_lock(&shared_database_lock);
+    if (!shared_database)
+    {
+        shared_database = load_dim4_heuristics();
+    }
+    const pattern_database *database = shared_database;
+    pthread_mutex_unlock(&shared_database_lock);
+    return database;
+}
+
+/*
+ * Returns a heuristic which needs no database, the larger of the walking
+ * distance and the Manhattan distance plus linear conflicts, building its
+ * tables on the first call. It is never released.
+ */
+const pattern_database *build_dim4_walking_distance(void)
+{
+    pthread_once(&tables_once, init_tables);
+    pthread_once(&walking_once, init_walking_distance);
+    return &walking_database;
 }
 
 /*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
+ * For the given positions of tiles and a tile pattern returns the index of the
+ * pattern's heuristic value in a database of the given layout, based on where
+ * the tiles in the pattern are on the board.
  */
-int arr_index(int board[DIM4_NUM_TILES], tile_pattern pattern, bool reflected)
+static int pattern_index(uint64_t positions, const tile_pattern *pattern,
+                         bool reflected, enum layout layout)
 {
+    int locations[DIM4_NUM_TILES];
+    for (int i = 0; i < pattern->num_tiles; i++)
+    {
+        // If we are computing a heuristic for the board reflected along its
+        // main diagonal we use the corresponding reflected pattern and must
+        // use the location of the tile under the reflection to get the index
+        // to lookup.
+        if (reflected)
+        {
+            int location = DIM4_UNPACK(positions, pattern->reflected_tiles[i]);
+            locations[i] = reflected_location[location];
+        }
+        else
+        {
+            locations[i] = DIM4_UNPACK(positions, pattern->tiles[i]);
+        }
+    }
+
+    if (layout == COMPACT_LAYOUT)
+    {
+        return compact_index(locations, pattern->num_tiles)
+               + pattern->compact_array_offset;
+    }
+
+    // In the sparse layout the locations are the digits of a base 16 index.
     int index = 0;
-    int k = 1;
+    for (int i = pattern->num_tiles - 1; i >= 0; i--)
+    {
+        index = index * DIM4_NUM_TILES + locations[i];
+    }
+    return index + pattern->array_offset;
+}
 
-    if (reflected)
+/*
+ * Swaps the contents of array[i] and array[j], increments a swap counter.
+ */
+static void swap(int array[], int i, int j, int *swap_count)
+{
+    if (array[i] == array[j])
+    {
+        return;
+    }
+    *swap_count += 1;
+    int temp = array[i];
+    array[i] = array[j];
+    array[j] = temp;
+    return;
+}
+
+/*
+ * Quicksorts an array between indices low and high inclusive. Also counts the
+ * number of swaps made whilst sorting.
+ */
+static void quicksort(int array[], int low, int high, int *swap_count)
+{
+    if (low < high)
     {
-        for (int i = 0; i < pattern.num_tiles; i++)
+        // Using array[high] as a pivot, partition the array and get the index
+        // of where the pivot should go.
+
+        // Track the new index where the pivot value should go once finished
+        int pivot_index = low;
+
+        // Loop through the array up to but not including pivot array[high].
+        for (int i = low; i < high; i++)
         {
-            for (int j = 0; j < DIM4_NUM_TILES; j++)
+            // Swap values as necessary comparing against the pivot value.
+            if (array[i] <= array[high])
             {
-                // If we are computed a heuristic for the board reflected along
-                // its main diagonal we use the corresponding reflected patten
-                // and must compute the location of the tile under the
-                // reflection to get the index to lookup.
-                if (pattern.reflected_tiles[i] == board[j])
-                {
-                    index += (DIM4 * j - ((DIM4_NUM_TILES - 1) * (j / DIM4))) * k;
-                    k *= DIM4_NUM_TILES;
-                    break;
-                }
+                swap(array, i, pivot_index, swap_count);
+                // If a swap is done, increment the new index for the pivot.
+                pivot_index++;
             }
         }
+
+        // Now swap the pivot currently at array[high] into the correct index.
+        swap(array, pivot_index, high, swap_count);
+
+        // Recursively call on sub-arrays below and above pivot index.
+        quicksort(array, low, pivot_index - 1, swap_count);
+        quicksort(array, pivot_index + 1, high, swap_count);
     }
-    else
+    return;
+}
+
+/*
+ * Returns true if the board holds each of the tiles 0 to 15 once and
+ * represents a solvable puzzle, returns false otherwise.
+ */
+bool is_dim4_solvable(const int board[DIM4_NUM_TILES])
+{
+    unsigned int tiles = 0;
+    for (int i = 0; i < DIM4_NUM_TILES; i++)
     {
-        for (int i = 0; i < pattern.num_tiles; i++)
+        if (board[i] < 0 || board[i] >= DIM4_NUM_TILES)
         {
-            for (int j = 0; j < DIM4_NUM_TILES; j++)
-            {
-                if (pattern.tiles[i] == board[j])
-                {
-                    index += j * k;
-                    k *= DIM4_NUM_TILES;
-                    break;
-                }
-            }
+            return false;
+        }
+        tiles |= 1u << board[i];
+    }
+    if (tiles != (1u << DIM4_NUM_TILES) - 1)
+    {
+        return false;
+    }
+
+    // To ensure a valid solvable puzzle, the parity of the permutation of the
+    // tiles 1 to 16 (with the empty tile being 16) plus the parity of the
+    // taxicab distance (number of rows plus number of columns) of the empty
+    // tile from the lower right corner, must be even. (This is an invariant
+    // for the puzzle moves.)
+
+    // Find the index of the empty tile.
+    int i;
+    for (i = 0; i < DIM4_NUM_TILES; i++)
+    {
+        if (board[i] == 0)
+        {
+            break;
         }
     }
 
-    return index;
+    // Copy the board and change the empty tile to a 16.
+    int array[DIM4_NUM_TILES];
+    memcpy(array, board, sizeof (int) * DIM4_NUM_TILES);
+    array[i] = DIM4_NUM_TILES;
+
+    // Quicksort the array and count the swaps.
+    int swap_count = 0;
+    quicksort(array, 0, DIM4_NUM_TILES - 1, &swap_count);
+    // Determine taxicab distance of empty tile.
+    int taxicab_dist = DIM4 - 1 - (i % DIM4) + DIM4 - 1 - (i / DIM4);
+
+    return (swap_count + taxicab_dist) % 2 == 0;
 }
 
+/*
+ * Attempts to parse a line of text of the given length as a list of 16 tile
+ * numbers into board, removing any trailing newline from the line. Returns
+ * true if it gives a solvable board, otherwise false.
+ */
+bool read_dim4_board(char *line, size_t num_chars,
+                     int board[DIM4_NUM_TILES])
+{
+    // Remove trailing newlines.
+    while (num_chars > 0
+           && (line[num_chars - 1] == '\r' || line[num_chars - 1] == '\n'))
+    {
+        num_chars--;
+        line[num_chars] = 0;
+    }
+
+    // Ensure we have a minimum number of characters that we might have a
+    // valid puzzle.
+    if (num_chars < MINIMUM_BOARD_CHARS)
+    {
+        return false;
+    }
+
+    char *p = line;
+    char *endptr = NULL;
+    int i = 0;
+    while (i < DIM4_NUM_TILES)
+    {
+        board[i] = (int) strtol(p, &endptr, 10);
+        if ((board[i] < 0 || board[i] > 15) || (p == endptr))
+        {
+            break;
+        }
+        p = endptr;
+        i++;
+    }
+
+    // Verify we have a solvable puzzle.
+    return i == DIM4_NUM_TILES && is_dim4_solvable(board);
+}
@@ -0,0 +1,124 @@
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dim4.h"
+
+#ifndef DIM4_SOLVER_H
+#define DIM4_SOLVER_H
+
+// A solution will have at most 80 moves.
+// http://www.iro.umontreal.ca/~gendron/Pisa/References/BB/Brungger99.pdf
+#define DIM4_MAX_MOVES 80
+
+// A database of heuristic values for the 4x4 solver. Once loaded it is only
+// read, so it may be shared by any number of contexts and threads.
+typedef struct pattern_database pattern_database;
+
+// The state of a 4x4 solver. A context may only be used by one thread at a
+// time but each thread may have its own, all sharing the same database.
+typedef struct dim4_context dim4_context;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Functions defined in dim4_solver.c, which together with dim3_solver.c,
+// dim4_partitions.c, dim4_database.c, heuristics_file.c and map_file.c make up
+// the library libfifteen.
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Reads the partitions declared in DIM4_PARTITIONS_FILE and maps the
+ * heuristic values of each of them on disk into memory, reading their layout
+ * and packing from the header of the file. Partitions whose file is missing,
+ * damaged or for different patterns are left out. Returns the database, or
+ * NULL if no partition could be loaded or upon any error. See map_file.h for
+ * how the mapping may be configured.
+ */
+pattern_database *load_dim4_heuristics(void);
+
+/*
+ * Maps the heuristic values of each of the given partitions, of which there
+ * may be at most MAX_PARTITIONS, into memory as for load_dim4_heuristics.
+ * Returns the database, or NULL if no partition could be loaded or upon any
+ * error.
+ */
+pattern_database *load_dim4_partitions(const partition partitions[],
+                                       int num_partitions);
+
+/*
+ * Releases a database returned by load_dim4_heuristics or
+ * load_dim4_partitions.
+ */
+void unload_dim4_heuristics(pattern_database *database);
+
+/*
+ * Returns the database loaded by load_dim4_heuristics which is shared by
+ * every caller, loading it on the first call, or returns NULL upon any error
+ * in which case a later call tries again. It is never released.
+ */
+const pattern_database *load_shared_dim4_heuristics(void);
+
+/*
+ * Returns a heuristic which needs no database, the larger of the walking
+ * distance and the Manhattan distance plus linear conflicts, building its
+ * tables on the first call. It is never released. It may be used in place of
+ * a loaded database, although solving hard puzzles takes much longer.
+ */
+const pattern_database *build_dim4_walking_distance(void);
+
+/*
+ * Returns a new context for solving puzzles with the given database, which
+ * must outlive the context. Each search uses num_threads threads, each with a
+ * transposition table of table_size bytes unless table_size is 0, and makes
+ * moves in order of their heuristic if ordered. Returns NULL upon an error.
+ */
+dim4_context *create_dim4_context(const pattern_database *database,
+                                  int num_threads, size_t table_size,
+                                  bool ordered);
+
+/*
+ * Releases a context returned by create_dim4_context.
+ */
+void free_dim4_context(dim4_context *context);
+
+/*
+ * Returns the number of nodes expanded by the searches of the context for the
+ * last puzzle it solved. A parallel search leaves out the few nodes expanded
+ * in splitting the search tree between the threads.
+ */
+long dim4_nodes_expanded(const dim4_context *context);
+
+/*
+ * Given a context and a board of the tiles 0 to 15, with 0 the empty tile,
+ * calls successive heuristic-guided depth-first searches until an optimal
+ * solution is found to the puzzle. Saves the tiles to move in turn in moves
+ * and returns how many there are. Returns -1 if the board is not a solvable
+ * puzzle or upon an error.
+ */
+int dim4_solver(dim4_context *context, const int board[DIM4_NUM_TILES],
+                uint8_t moves[DIM4_MAX_MOVES]);
+
+/*
+ * Returns true if the board holds each of the tiles 0 to 15 once and
+ * represents a solvable puzzle, returns false otherwise.
+ */
+bool is_dim4_solvable(const int board[DIM4_NUM_TILES]);
+
+/*
+ * Attempts to parse a line of text of the given length as a list of 16 tile
+ * numbers into board, removing any trailing newline from the line. Returns
+ * true if it gives a solvable board, otherwise false.
+ */
+bool read_dim4_board(char *line, size_t num_chars,
+                     int board[DIM4_NUM_TILES]);
+
+/*
+ * Returns the heuristic value the database gives a board of the tiles 0 to
+ * 15, a lower bound on the number of moves to solve it, or -1 if the board is
+ * not a solvable puzzle.
+ */
+int dim4_heuristic(const pattern_database *database,
+                   const int board[DIM4_NUM_TILES]);
+
+#endif
@@ -29,13 +29,20 @@
  *
  * Optionally the following files can be used so that the automatic solver may
  * will produce optimal solutions in the 3x3 and 4x4 cases of the puzzle.
- * - generate_dim3_solutions.c - used to generate a small binary file
- *   containing optimal solutions for the 3x3 puzzle.
+ * - dim3_solver.c - builds optimal solutions for the 3x3 puzzle in memory
+ *   when first needed, part of the library libfifteen. The program
+ *   generate_dim3_solutions.c saves them to a small binary file.
  * - generate_dim4_heuristics.c - used to generate a large (11.5 MB) binary
  *   file containing heuristic data to aid the 4x4 puzzle solver.
  * - dim4_solver.c - implements an optimal solver for the 4x4 puzzle case using
- *   the heuristic data. This program can also be run independently to read in
- *   and solve 4x4 puzzles optimally.
+ *   the heuristic data, built into the library libfifteen. The program
+ *   standalone_dim4_solver.c uses the same library to read in and solve 4x4
+ *   puzzles optimally.
+ * - heuristics_file.c - reads and writes the header describing the data in
+ *   each of the binary files, also part of libfifteen.
+ * - dim4_database.c - saves the heuristic data of each pattern separately as
+ *   it is generated and merges them into the binary file, also part of
+ *   libfifteen. The program merge_dim4_heuristics.c merges them on its own.
  */
 
 #define _XOPEN_SOURCE 500
@@ -49,6 +56,7 @@
 #include <string.h>
 #include <time.h>
 
+#include "dim3_solver.h"
 #include "fifteen.h"
 
 // Macro for processing control characters.
@@ -100,9 +108,10 @@ int main(int argc, char *argv[])
     draw_header_footer();
     draw_board();
 
-    // Arrays which may be used by solver.
-    uint8_t *dim3_array = NULL;
-    uint8_t *dim4_array = NULL;
+    // Build the 3x3 solutions in the background, so they are likely ready by
+    // the time god mode needs them. Without the thread god mode builds them
+    // itself. The 4x4 solver's data is shared, see dim4_solver.h.
+    start_dim3_solutions();
 
     // The user's input.
     int ch;
@@ -167,7 +176,7 @@ int main(int argc, char *argv[])
             case 'G':
                 if (p.puzzle_state == UNSOLVED)
                 {
-                    if (!god_mode(&dim3_array, &dim4_array))
+                    if (!god_mode())
                     {
                         // An error message is produced.
                         p.puzzle_state = THERE_IS_NO_GOD;
@@ -197,16 +206,6 @@ int main(int argc, char *argv[])
     // Shutdown ncurses.
     endwin();
 
-    // Free malloc'd memory.
-    if (dim3_array)
-    {
-        free(dim3_array);
-    }
-    if (dim4_array)
-    {
-        free(dim4_array);
-    }
-
     // Clears screen using ANSI escape sequences.
     printf("\033[2J");
     printf("\033[%d;%dH", 0, 0);
@@ -24,6 +24,11 @@ struct puzzle {
     int empty_row;
     int empty_col;
 
+    // The inverse of board, i.e. the row and column where each tile is
+    // currently located, so that tiles can be found without a search.
+    int tile_row[DIM_MAX * DIM_MAX];
+    int tile_col[DIM_MAX * DIM_MAX];
+
     // A count of the number of moves made.
     int move_number;
 
@@ -35,26 +40,6 @@ struct puzzle {
 extern struct puzzle p;
 
 
-////////////////////////////////////////////////////////////////////////////////
-// Functions defined in dim4_solver.c
-////////////////////////////////////////////////////////////////////////////////
-
-/*
- * Loads heuristic values from disk into an array and returns a pointer to that
- * array.
- */
-uint8_t *load_dim4_heuristics(void);
-
-/*
- * Given an offset so that we can identify a the 4x4 lower right corner of the
- * puzzle, and given an array of heuristic values, calls successive
- * heuristic-guided depth-first searches until an optimal solution is found to
- * arrange the 4x4 tiles correctly. Returns true on success. Otherwise returns
- * false.
- */
-bool dim4_solver(int board_offset, uint8_t *dim4_array);
-
-
 ////////////////////////////////////////////////////////////////////////////////
 // Functions defined in fifteen.c
 ////////////////////////////////////////////////////////////////////////////////
@@ -96,7 +81,7 @@ bool is_solved(void);
  * puzzle, calls a series of moves until the puzzle is solved. Returns true
  * upon success, false otherwise.
  */
-bool god_mode(uint8_t **dim3_array, uint8_t **dim4_array);
+bool god_mode(void);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -313,21 +313,8 @@ void move_empty_to_right_of_target(int target_row, int target_col)
 void move_target_to_row(int target_tile, int destination_row)
 {
     // Find current row and column of target tile.
-    int target_row;
-    int target_col;
-    for (int row = 0; row < p.dim; row++)
-    {
-        for (int col = 0; col < p.dim; col++)
-        {
-            if (p.board[row][col] == target_tile)
-            {
-                target_row = row;
-                target_col = col;
-                row = p.dim;
-                col = p.dim;
-            }
-        }
-    }
+    int target_row = p.tile_row[target_tile];
+    int target_col = p.tile_col[target_tile];
 
     // Determine how many rows we want to move the target by.
     int num_rows = destination_row - target_row;
@@ -386,21 +373,8 @@ void move_target_to_row(int target_tile, int destination_row)
 void move_target_to_col(int target_tile, int destination_col)
 {
     // Find current row and column of target tile.
-    int target_row;
-    int target_col;
-    for (int row = 0; row < p.dim; row++)
-    {
-        for (int col = 0; col < p.dim; col++)
-        {
-            if (p.board[row][col] == target_tile)
-            {
-                target_row = row;
-                target_col = col;
-                row = p.dim;
-                col = p.dim;
-            }
-        }
-    }
+    int target_row = p.tile_row[target_tile];
+    int target_col = p.tile_col[target_tile];
 
     // Determine how many columns we want to move the target by.
     int num_cols = destination_col - target_col;
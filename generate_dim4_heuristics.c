@@ -80,6 +80,32 @@
  * 16! / (16 - 7)! = 57657600 nodes but ultimately only write the disk costs
  * for 16! / (16 - 6)! = 5765760 nodes.
  *
+ * Rather than keeping a queue of nodes the search is made level by level over
+ * the visited array itself. Every state reached at the current cost is
+ * expanded, in blocks of the array shared out between threads, before any
+ * state of the next cost. Moves of tiles outside the pattern cost nothing and
+ * only move the empty tile around the region of cells not taken by the
+ * pattern's tiles which it is in, so every location of the empty tile in that
+ * region has the same cost. Each region is therefore searched as a single
+ * state, with the empty tile at the first location of the region, found by
+ * filling the region over a bit set of the board's cells. Expanding it moves
+ * each tile of the pattern next to the region into it, at a cost of one. A
+ * single sweep of the array then finishes each level, and each region is
+ * expanded exactly once, which for the 6 tile patterns is nearly 5 times
+ * fewer states than with every location of the empty tile. The patterns of a
+ * partition are searched at the same time, so generating a database takes
+ * seconds given enough processors. The option -j sets the number of threads,
+ * by default one for each processor, and the cost of each level is reported
+ * as the search goes.
+ *
+ * The visited array need not hold the cost of each state, only whether it is
+ * not yet reached, closed, or open at the current cost or the next, which is
+ * 2 bits per state. The empty tile is indexed last, so the states of one
+ * arrangement of the pattern's tiles lie together, and the heuristic value of
+ * that arrangement is simply the cost at which the first of its regions is
+ * closed. Only the first location of each region is ever reached, the others
+ * are left as they are.
+ *
  * It would also be possible to simply include the empty tile in each of the
  * tile patterns at the cost of needing to save a much larger number of
  * heuristic values to disk but with the benefit of a slightly better
@@ -98,9 +124,30 @@
  * roughly 11MB.
  *
  * Between the four options of excluding or including the empty tile in the
- * patterns and sparse or compact storage, testing shows trade offs in time and
- * space are best when excluding the empty tile from the patterns and using
- * sparse storage.
+ * patterns and sparse or compact storage, testing showed trade offs in time
+ * and space were best when excluding the empty tile from the patterns and
+ * using sparse storage. However the solvers now update a pattern's index only
+ * when one of its tiles moves, and ranking the 6 locations of a pattern is a
+ * handful of shifts and popcounts, so the compact storage costs little more
+ * per lookup. In return the database is a third of the size and much more of
+ * it stays in cache. Run with the option -c to save the compact layout, the
+ * solvers read which layout they are given from the header of the file.
+ *
+ * Larger patterns give a better heuristic. With the option -p 7-8 the program
+ * instead generates a database for the 7,8 tile patterns [1,5,6,9,10,13,14]
+ * and [2,3,4,7,8,11,12,15], always in the compact layout since this takes
+ * 16!/9! + 16!/8! bytes, around 577MB. Any pattern of more than 6 tiles is
+ * likewise only saved compactly. Searching the 8 tile pattern visits
+ * 16!/7! states so even at 2 bits each the visited array takes over 1GB,
+ * which is why the visited states are always indexed compactly.
+ *
+ * Either layout can be halved in size again with the option -n. Each move of
+ * a tile changes its taxi-cab distance [4] from its solved location by one, so
+ * a pattern's cost less the taxi-cab distances of its tiles is an even number
+ * of 'extra' moves. For the patterns used this is never more than 12, so half
+ * of it fits in 4 bits and two values are packed into each byte. The solvers
+ * track the taxi-cab distance as tiles move and add it back, so the packed
+ * database gives exactly the same heuristic.
  *
  * When solving puzzles we can speed up the solver considerably by noting that
  * the heuristic values calculated would also be valid heuristic values for the
@@ -118,8 +165,25 @@
  * Thus for a particular puzzle state we can look up two heuristic values and
  * use the maximum of the two to guide the search.
  *
- * Constants for the particular tile patterns used are given in 'dim4.h' and
- * the database this program produces is saved as 'dim4_heuristics.bin'.
+ * The partitions of the tiles into patterns are declared in the text file
+ * 'dim4_partitions.txt', each with the name of the file its database is saved
+ * in, so new partitions can be tried without rebuilding anything. The option
+ * -p chooses the partition by name, by default the first, 6-6-3, saved as
+ * 'dim4_heuristics.bin', and -f reads the partitions from another file, such
+ * as candidates to compare with select_dim4_partitions. Different partitions
+ * underestimate the cost of different boards, so the solvers use the database
+ * of every partition that has been generated and take the largest of their
+ * heuristic values.
+ *
+ * Searching large patterns can take hours, so nothing is lost should the
+ * program be stopped. The heuristic values of each pattern are saved in a
+ * slice of their own as soon as its search is done, see dim4_database.h, and
+ * between levels of the search the visited array and the values found so far
+ * are saved in a checkpoint, no more often than every 5 minutes or as given in
+ * seconds with -i. With the option -r the patterns whose slices are saved are
+ * skipped and the others resumed from their checkpoints. Once every pattern
+ * is searched the slices are merged into the database, unless the option -s
+ * leaves that to merge_dim4_heuristics.
  *
  * 1. https://en.wikipedia.org/wiki/Iterative_deepening_A*
  * 2. https://codereview.stackexchange.com/a/108631
@@ -134,305 +198,847 @@
  * 11. https://stackoverflow.com/a/14374455
  */
 
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "dim4.h"
+#include "dim4_database.h"
+#include "dim4_partitions.h"
+#include "heuristics_file.h"
+
+// The least number of seconds between checkpoints of the search of a pattern,
+// unless given with -i.
+#define CHECKPOINT_SECONDS 300
 
-// The current state of the board is encapsulated in a node. These
-// nodes will be used for a linked list implementation of a queue.
-typedef struct node
+// Added to the name of the slice of a pattern for the name of its checkpoint.
+#define CHECKPOINT_SUFFIX ".checkpoint"
+
+// The columns of the board as bit sets of locations, see neighbouring_cells.
+#define LEFT_COLUMN 0x1111
+#define RIGHT_COLUMN 0x8888
+
+// Each state of the visited array is given in 2 bits, 4 states to a byte. A
+// state is either not yet reached, closed once the moves from it have been
+// made, or reached but still open. Open states of the current cost and of the
+// next cost take the two remaining values in turn, see OPEN_STATE, since once
+// a cost is done none of its states remain open.
+#define STATES_PER_BYTE 4
+#define UNVISITED 0
+#define CLOSED 3
+#define OPEN_STATE(cost) (1 + (cost) % 2)
+
+// The number of arrangements of a pattern's tiles, each with every location
+// of the empty tile, which a thread takes to work on at a time. A multiple of
+// STATES_PER_BYTE, so that blocks never share a byte of the visited array.
+#define BLOCK_ARRANGEMENTS (1 << 14)
+
+// The phases of the search of a pattern. Each sweep expands the open states
+// of the visited array of the current cost.
+enum phase { SWEEP, FINISHED };
+
+// The state shared by the threads searching a single pattern, see
+// bfs_tile_pattern.
+typedef struct
 {
-    uint8_t board[DIM4_NUM_TILES];
-    uint8_t empty_index;
-    uint8_t heuristic;
-    struct node *next;
+    tile_pattern pattern;
+    enum layout layout;
+    // The heuristic values of the pattern alone, from its first.
+    uint8_t *heuristics;
+    // The pattern's place in its partition, to report progress.
+    int number;
+    // The state of each arrangement of the pattern's tiles and the empty
+    // tile, indexed compactly with the empty tile last, so that the states of
+    // one arrangement of the pattern's tiles are together.
+    atomic_uchar *visited;
+    int64_t visited_states;
+    // The current phase and, whilst sweeping, the cost of the states being
+    // expanded and how many were expanded.
+    enum phase phase;
+    int cost;
+    atomic_llong expanded;
+    // The number of states in each block of the visited array, and of blocks,
+    // and the next block to be taken.
+    int64_t block_states;
+    int64_t num_blocks;
+    atomic_llong next_block;
+    // The threads wait on started for each new phase, whose number is
+    // phase_number, and the thread coordinating the search waits on finished
+    // for num_working to fall to zero once it is done.
+    pthread_mutex_t lock;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+    int phase_number;
+    int num_working;
+    int num_threads;
 }
-node;
+pattern_search;
+
+// A pattern of a partition to be searched by its own thread, see
+// search_pattern.
+typedef struct
+{
+    const partition *partition;
+    int number;
+    enum layout layout;
+    int num_threads;
+    // Whether to resume the search from its checkpoint, if any, and the least
+    // number of seconds between checkpoints.
+    bool resume;
+    int checkpoint_seconds;
+    bool success;
+}
+pattern_job;
+
+/*
+ * The work of the thread searching a single pattern of a partition, see
+ * bfs_tile_pattern.
+ */
+void *search_pattern(void *arg);
+
+/*
+ * Using the tile pattern of the given job, performs a breadth-first search
+ * over all possible permuations of the tiles in the pattern and the empty
+ * tile, calculating a cost value as it goes and saving those values to the
+ * pattern's slice, see dim4_database.h. The search is shared by the job's
+ * threads, including this one, and is saved to a checkpoint from time to
+ * time. Returns true upon success, false otherwise.
+ */
+bool bfs_tile_pattern(const pattern_job *job);
+
+/*
+ * Loads the search of the given pattern, in the given layout, from the named
+ * checkpoint into the length bytes of data. Returns the cost of the level to
+ * resume the search from, or -1 if there is no such checkpoint.
+ */
+int load_checkpoint(const char *filename, const tile_pattern *pattern,
+                    enum layout layout, uint8_t data[], int64_t length);
 
 /*
- * Using the given tile pattern, performs a breadth-first search over all
- * possible permuations of the tiles in the pattern and the empty tile,
- * calculating a cost value as it goes and saving those values to the
- * heuristics array. Returns true upon success, false otherwise.
+ * Saves the length bytes of data of the search of the given pattern, in the
+ * given layout, to the named checkpoint, to be resumed from the given level.
+ * Returns false upon any error.
  */
-bool bfs_tile_pattern(tile_pattern pattern, uint8_t heuristics[]);
+bool save_checkpoint(const char *filename, const tile_pattern *pattern,
+                     enum layout layout, const uint8_t data[], int64_t length,
+                     int level);
 
 /*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
+ * Starts the given phase of the search ps on every thread and, unless it is
+ * FINISHED, works on it until every thread is done.
  */
-int arr_index(uint8_t board[DIM4_NUM_TILES], tile_pattern pattern);
+void run_phase(pattern_search *ps, enum phase phase);
 
 /*
- * Takes a node and adds it to the back of the queue.
+ * The work of each thread of the search of a pattern besides the one
+ * coordinating it. Works on each phase of the search as it starts.
  */
-void enqueue(node *n, node **front, node **back);
+void *search_blocks(void *arg);
 
 /*
- * Removes and returns a node from the front of the queue.
+ * Takes blocks of the current phase of the search ps and works on them until
+ * there are none left.
  */
-node *dequeue(node **front);
+void work_on_phase(pattern_search *ps);
 
+/*
+ * Closes and expands each open state of the current cost from start up to end
+ * of the visited array of the search ps. Returns the number of states
+ * expanded.
+ */
+int64_t sweep_block(pattern_search *ps, int64_t start, int64_t end);
 
-int main(void)
+/*
+ * Makes every move of a tile in the pattern into the region of the closed
+ * state at the given index of the visited array of the search ps, opening
+ * each state reached at the next cost. Records the cost as the heuristic
+ * value of the arrangement of the pattern's tiles unless it already has one.
+ */
+void expand_region(pattern_search *ps, int64_t index, int cost);
+
+/*
+ * Returns the cells, given as a bit set of locations, which are next to any of
+ * the given cells.
+ */
+unsigned int neighbouring_cells(unsigned int cells);
+
+/*
+ * Returns the region of the given unoccupied cells which may be reached from
+ * the given cells, as bit sets of locations, by moving only between
+ * unoccupied cells next to one another.
+ */
+unsigned int fill_region(unsigned int cells, unsigned int unoccupied);
+
+/*
+ * Changes the state at the given index of a visited array from one value to
+ * another, returning false if its value was not from.
+ */
+bool change_state(atomic_uchar visited[], int64_t index, int from, int to);
+
+
+int main(int argc, char *argv[])
 {
-    // Initialise an array to save all the heuristic values in.
-    uint8_t *heuristics = malloc(TOTAL_STATES);
-    if (!heuristics)
+    // Choose the partition, by default the first in the file, and the layout
+    // of the database to save.
+    const char *filename = DIM4_PARTITIONS_FILE;
+    const char *name = NULL;
+    enum layout layout = SPARSE_LAYOUT;
+    bool packed = false;
+    // Whether to resume from the slices and checkpoints of an earlier run,
+    // how often to save checkpoints and whether to leave the slices to be
+    // merged by merge_dim4_heuristics.
+    bool resume = false;
+    int checkpoint_seconds = CHECKPOINT_SECONDS;
+    bool slices_only = false;
+    // The number of threads searching the patterns, by default one for each
+    // processor.
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    int opt;
+    while ((opt = getopt(argc, argv, "cf:i:j:np:rs")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                layout = COMPACT_LAYOUT;
+                break;
+            case 'f':
+                filename = optarg;
+                break;
+            case 'n':
+                packed = true;
+                break;
+            case 'p':
+                name = optarg;
+                break;
+            case 'r':
+                resume = true;
+                break;
+            case 's':
+                slices_only = true;
+                break;
+            case 'i':
+                checkpoint_seconds = atoi(optarg);
+                break;
+            case 'j':
+                num_threads = atol(optarg);
+                if (num_threads >= 1)
+                {
+                    break;
+                }
+                // Fall through.
+            default:
+                fprintf(stderr, "Usage: %s [-c] [-n] [-r] [-s] [-i seconds] "
+                        "[-j threads] [-f partitions_file] [-p partition]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    // The partitions which may be generated.
+    partition partitions[MAX_PARTITIONS];
+    char error[PARTITIONS_ERROR_CHARS];
+    int num_partitions = read_dim4_partitions(filename, partitions, error);
+    if (num_partitions == -1)
+    {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    const partition *partition = name ? NULL : &partitions[0];
+    for (int i = 0; name && i < num_partitions; i++)
     {
+        if (strcmp(name, partitions[i].name) == 0)
+        {
+            partition = &partitions[i];
+        }
+    }
+    if (!partition)
+    {
+        fprintf(stderr, "No partition %s is declared in %s\n", name,
+                filename);
         return 1;
     }
-    for (int i = 0; i < TOTAL_STATES; i++)
+
+    // Partitions with large patterns are only saved in the compact layout.
+    if (partition->total_states == 0)
     {
-        heuristics[i] = UINT8_MAX;
+        layout = COMPACT_LAYOUT;
     }
 
     // For each tile pattern, perform a breadth-first search saving the
-    // heuristic values in the heuristics.
-    bool success;
-    for (int i = 0; i < NUM_PATTERNS; i++)
+    // heuristic values in the pattern's slice, unless resuming and it has
+    // already been saved. The patterns are searched at the same time, each by
+    // a share of the threads in proportion to the size of its search. Should
+    // a thread fail to start, its pattern is searched once the others are
+    // done.
+    int num_patterns = partition->num_patterns;
+    pattern_job jobs[MAX_PATTERNS];
+    pthread_t threads[MAX_PATTERNS];
+    bool searching[MAX_PATTERNS];
+    bool started[MAX_PATTERNS];
+    int64_t all_visited_states = 0;
+    for (int i = 0; i < num_patterns; i++)
     {
-        success = bfs_tile_pattern(patterns[i], heuristics);
-        if (!success)
+        searching[i] = !resume || !have_dim4_slice(partition, i + 1, layout);
+        if (searching[i])
         {
-            if (heuristics)
-            {
-                free(heuristics);
-            }
-            return 1;
+            all_visited_states += num_arrangements(
+                partition->patterns[i].num_tiles + 1);
+        }
+        else
+        {
+            char slice[MAX_SLICE_FILE];
+            dim4_slice_filename(partition, i + 1, slice);
+            printf("Pattern %i: already saved in %s\n", i + 1, slice);
         }
     }
-
-    // Write the array to disk and free memory.
-    FILE *file = fopen(DIM4_HEURISTICS_FILE, "wb");
-    if (!file)
+    for (int i = 0; i < num_patterns; i++)
     {
-        return 1;
+        if (!searching[i])
+        {
+            continue;
+        }
+        tile_pattern pattern = partition->patterns[i];
+        jobs[i].partition = partition;
+        jobs[i].number = i + 1;
+        jobs[i].layout = layout;
+        jobs[i].num_threads = num_threads
+                              * num_arrangements(pattern.num_tiles + 1)
+                              / all_visited_states;
+        if (jobs[i].num_threads < 1)
+        {
+            jobs[i].num_threads = 1;
+        }
+        jobs[i].resume = resume;
+        jobs[i].checkpoint_seconds = checkpoint_seconds;
+        started[i] = pthread_create(&threads[i], NULL, search_pattern,
+                                    &jobs[i]) == 0;
+    }
+    bool success = true;
+    for (int i = 0; i < num_patterns; i++)
+    {
+        if (!searching[i])
+        {
+            continue;
+        }
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            search_pattern(&jobs[i]);
+        }
+        success = success && jobs[i].success;
     }
-    if (fwrite(heuristics, TOTAL_STATES, 1, file) != 1)
+    if (!success)
     {
-        fclose(file);
         return 1;
     }
-    fclose(file);
 
-    if (heuristics)
+    // Merge the slices into the database, after a header describing it.
+    if (!slices_only)
     {
-        free(heuristics);
+        char database_error[DATABASE_ERROR_CHARS];
+        if (!merge_dim4_slices(partition, layout, packed, database_error))
+        {
+            fprintf(stderr, "%s\n", database_error);
+            return 1;
+        }
     }
 
     return 0;
 }
 
 /*
- * Using the given tile pattern, performs a breadth-first search over all
- * possible permuations of the tiles in the pattern and the empty tile,
- * calculating a cost value as it goes and saving those values to the
- * heuristics array. Returns true upon success, false otherwise.
+ * The work of the thread searching a single pattern of a partition, see
+ * bfs_tile_pattern.
  */
-bool bfs_tile_pattern(tile_pattern pattern, uint8_t heuristics[])
+void *search_pattern(void *arg)
 {
-    // Create and initialise a root node.
-    node *root = malloc(sizeof (node));
-    if (root == NULL)
+    pattern_job *job = arg;
+    job->success = bfs_tile_pattern(job);
+    return NULL;
+}
+
+/*
+ * Using the tile pattern of the given job, performs a breadth-first search
+ * over all possible permuations of the tiles in the pattern and the empty
+ * tile, calculating a cost value as it goes and saving those values to the
+ * pattern's slice, see dim4_database.h. The search is shared by the job's
+ * threads, including this one, and is saved to a checkpoint from time to
+ * time. Returns true upon success, false otherwise.
+ */
+bool bfs_tile_pattern(const pattern_job *job)
+{
+    tile_pattern pattern = job->partition->patterns[job->number - 1];
+    int number = job->number;
+    pattern_search ps;
+    ps.pattern = pattern;
+    ps.layout = job->layout;
+    ps.number = number;
+
+    // When we search we need to track which states are already visited and
+    // those states must include the empty tile. It is always indexed
+    // compactly since for larger patterns 16^n entries would be far too many.
+    // The heuristic values of the pattern follow it in the same allocation,
+    // so that together they may be saved as a checkpoint.
+    int num_tiles = pattern.num_tiles;
+    ps.visited_states = num_arrangements(num_tiles + 1);
+    int64_t visited_length = (ps.visited_states + STATES_PER_BYTE - 1)
+                             / STATES_PER_BYTE;
+    int64_t length = visited_length + pattern_states(&pattern, ps.layout);
+    uint8_t *data = malloc(length);
+    if (!data)
     {
         return false;
     }
-    // Aside from tiles in the pattern and the empty tile, we want other tiles
-    // to have the same sentinel value.
-    for (int i = 0; i < DIM4_NUM_TILES; i++)
+    ps.visited = (atomic_uchar *) data;
+    ps.heuristics = data + visited_length;
+    ps.block_states = (int64_t) BLOCK_ARRANGEMENTS
+                      * (DIM4_NUM_TILES - num_tiles);
+    ps.num_blocks = (ps.visited_states + ps.block_states - 1)
+                    / ps.block_states;
+
+    char checkpoint[MAX_SLICE_FILE + sizeof(CHECKPOINT_SUFFIX)];
+    dim4_slice_filename(job->partition, number, checkpoint);
+    strcat(checkpoint, CHECKPOINT_SUFFIX);
+    int first_cost = job->resume ? load_checkpoint(checkpoint, &pattern,
+                                                   ps.layout, data, length)
+                                 : -1;
+    if (first_cost == -1)
     {
-        root->board[i] = UINT8_MAX;
+        // Every state starts out not yet reached and no heuristic value is
+        // yet recorded.
+        first_cost = 0;
+        memset(data, UNVISITED, visited_length);
+        memset(ps.heuristics, UINT8_MAX, length - visited_length);
+
+        // The root is the solved arrangement, open at no cost, with the empty
+        // tile at the first location of its region.
+        int locations[DIM4_NUM_TILES + 1];
+        unsigned int taken = 0;
+        for (int i = 0; i < num_tiles; i++)
+        {
+            locations[i] = pattern.tiles[i] - 1;
+            taken |= 1u << locations[i];
+        }
+        locations[num_tiles] = __builtin_ctz(
+            fill_region(1u << (DIM4_NUM_TILES - 1), ~taken & 0xFFFF));
+        change_state(ps.visited, compact_index(locations, num_tiles + 1),
+                     UNVISITED, OPEN_STATE(0));
     }
-    for (int i = 0; i < pattern.num_tiles; i++)
+    else
     {
-        root->board[pattern.tiles[i] - 1] = pattern.tiles[i];
+        printf("Pattern %i: resuming from %s at cost %i\n", number,
+               checkpoint, first_cost);
     }
-    root->empty_index = DIM4_NUM_TILES - 1;
-    root->board[root->empty_index] = 0;
-    root->heuristic = 0;
-    root->next = NULL;
-
-    // Initialise the front and back of our queue of nodes.
-    node *front = root;
-    node *back = root;
-
-    // Save the heuristic value for the root node in the heuristics array.
-    int index = arr_index(root->board, pattern);
-    // The index into the array must include an offset so that heuristics for
-    // each pattern are saved in a single array.
-    heuristics[index + pattern.array_offset] = root->heuristic;
 
-    // When we search we need to track which states are already visited and
-    // those states must include the empty tile. We will use a new tile pattern
-    // for this which includes 0.
-    tile_pattern visited_pattern;
-    visited_pattern.num_tiles = pattern.num_tiles + 1;
-    visited_pattern.tiles[0] = 0;
-    for (int i = 0; i < pattern.num_tiles; i++)
-    {
-        visited_pattern.tiles[i + 1] = pattern.tiles[i];
-    }
-    // We don't need the array_offset member since we use a fresh visited array
-    // for each search.
+    pthread_mutex_init(&ps.lock, NULL);
+    pthread_cond_init(&ps.started, NULL);
+    pthread_cond_init(&ps.finished, NULL);
+    ps.phase_number = 0;
+    ps.num_working = 0;
 
-    // Initialise an array to save to heuristic values for the visited states.
-    uint8_t *visited = malloc(VISITED_STATES);
-    if (visited == NULL)
+    // Should a thread fail to start, the others simply take its share of the
+    // blocks.
+    pthread_t *threads = malloc(job->num_threads * sizeof(pthread_t));
+    if (!threads)
     {
+        free(data);
         return false;
     }
-    for (int i = 0; i < VISITED_STATES; i++)
+    ps.num_threads = 1;
+    for (int i = 1; i < job->num_threads; i++)
     {
-        visited[i] = UINT8_MAX;
+        if (pthread_create(&threads[ps.num_threads - 1], NULL, search_blocks,
+                           &ps) == 0)
+        {
+            ps.num_threads++;
+        }
     }
 
-    // Save the heuristic value for the root node in the visited array. We can
-    // use the same arr_index function to get an index provided we now call it
-    // with the visited_pattern.
-    index = arr_index(root->board, visited_pattern);
-    visited[index] = root->heuristic;
+    // The search is level by level, expanding every state of one cost before
+    // any of the next, so a single sweep finishes each level. The heuristic
+    // value of each arrangement of the pattern's tiles is then the cost at
+    // which the first state with that arrangement is closed. Between levels
+    // no thread is changing the states, so they may be saved as a checkpoint
+    // to resume the search from the next level.
+    struct timespec start;
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct timespec level_start = start;
+    struct timespec last_checkpoint = start;
+    int64_t num_states = 0;
+    bool success = true;
+    for (ps.cost = first_cost; ; ps.cost++)
+    {
+        // Costs must fit in the heuristics without being taken for a value
+        // not yet recorded.
+        if (ps.cost >= UINT8_MAX)
+        {
+            success = false;
+            break;
+        }
 
-    // Note the heuristic values we save in heuristics are each a minimum of
-    // those heuristic values we save in the visited array which have the same
-    // arrangement of tiles in the pattern but with the empty tile located in
-    // different places.
+        run_phase(&ps, SWEEP);
+        int64_t level_states = atomic_load(&ps.expanded);
+        if (!level_states)
+        {
+            break;
+        }
+        num_states += level_states;
 
-    while (front)
-    {
-        node *n = dequeue(&front);
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        printf("Pattern %i: cost %2i, %10lli states, %.3f seconds\n", number,
+               ps.cost, (long long) level_states,
+               (finish.tv_sec - level_start.tv_sec)
+               + (finish.tv_nsec - level_start.tv_nsec) / 1e9);
+        fflush(stdout);
+        level_start = finish;
 
-        // Find neighbours by looking up valid moves.
-        for (int j = 0; j < 4; j++)
+        // A checkpoint which cannot be saved only means there is less to
+        // resume from.
+        if (finish.tv_sec - last_checkpoint.tv_sec >= job->checkpoint_seconds)
         {
-            int move_index = valid_moves[n->empty_index][j];
-            if (move_index != -1)
+            if (!save_checkpoint(checkpoint, &pattern, ps.layout, data, length,
+                                 ps.cost + 1))
             {
-                int tile = n->board[move_index];
+                fprintf(stderr, "Pattern %i: unable to save %s\n", number,
+                        checkpoint);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &last_checkpoint);
+        }
+    }
 
-                // To reduce calls to malloc and memcpy, make the move on the
-                // node n first, then undo it later.
-                n->board[n->empty_index] = tile;
-                n->board[move_index] = 0;
+    if (success)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        printf("Pattern %i: %lli states searched in %.3f seconds\n", number,
+               (long long) num_states, (finish.tv_sec - start.tv_sec)
+                                       + (finish.tv_nsec - start.tv_nsec)
+                                         / 1e9);
+        fflush(stdout);
+    }
 
-                int heuristic = n->heuristic;
-                // Only add to heuristic for moves of tiles in the pattern.
-                if (tile != UINT8_MAX)
-                {
-                    heuristic++;
-                }
+    run_phase(&ps, FINISHED);
+    for (int i = 0; i < ps.num_threads - 1; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&ps.lock);
+    pthread_cond_destroy(&ps.started);
+    pthread_cond_destroy(&ps.finished);
 
-                index = arr_index(n->board, visited_pattern);
+    // Save the pattern's slice, which replaces its checkpoint.
+    if (success)
+    {
+        success = write_dim4_slice(job->partition, number, ps.layout,
+                                   ps.heuristics);
+        if (success)
+        {
+            remove(checkpoint);
+        }
+        else
+        {
+            fprintf(stderr, "Pattern %i: unable to save its slice\n", number);
+        }
+    }
+    free(data);
+    return success;
+}
 
-                if (visited[index] <= heuristic)
-                {
-                    // We've seen this state but it had a lower heuristic. Use
-                    // that value instead.
-                    heuristic = visited[index];
-                }
+/*
+ * Loads the search of the given pattern, in the given layout, from the named
+ * checkpoint into the length bytes of data. Returns the cost of the level to
+ * resume the search from, or -1 if there is no such checkpoint.
+ */
+int load_checkpoint(const char *filename, const tile_pattern *pattern,
+                    enum layout layout, uint8_t data[], int64_t length)
+{
+    heuristics_header header;
+    const uint8_t *checkpoint = map_heuristics_file(filename, DIM4_CHECKPOINT,
+                                                    true, &header);
+    if (!checkpoint)
+    {
+        return -1;
+    }
+    int level = -1;
+    if (header_matches_pattern(&header, DIM4_CHECKPOINT, pattern, layout,
+                               length)
+        && header.level < UINT8_MAX)
+    {
+        memcpy(data, checkpoint, length);
+        level = header.level;
+    }
+    unmap_heuristics_file(checkpoint, header.length);
+    return level;
+}
 
-                else if (visited[index] > heuristic)
-                {
-                    // Either we've seen this state before but it had a higher
-                    // heuristic or this state is unseen. Either way we need a
-                    // new node to add to our queue so we can explore this path
-                    // further.
-                    visited[index] = heuristic;
-
-                    // Create a neighbour node and initialise it.
-                    node *neighbour = malloc(sizeof(node));
-                    if (!neighbour)
-                    {
-                        return false;
-                    }
-                    memcpy(neighbour, n, sizeof (node));
-                    neighbour->empty_index = move_index;
-                    neighbour->heuristic = heuristic;
-                    enqueue(neighbour, &front, &back);
-                }
+/*
+ * Saves the length bytes of data of the search of the given pattern, in the
+ * given layout, to the named checkpoint, to be resumed from the given level.
+ * Returns false upon any error.
+ */
+bool save_checkpoint(const char *filename, const tile_pattern *pattern,
+                     enum layout layout, const uint8_t data[], int64_t length,
+                     int level)
+{
+    heuristics_header header;
+    init_pattern_header(&header, DIM4_CHECKPOINT, pattern, layout, length);
+    header.level = level;
+    return write_heuristics_file(filename, &header, data);
+}
 
-                // Now store the heuristic.
-                index = arr_index(n->board, pattern);
-                if (heuristics[index + pattern.array_offset] > heuristic)
-                {
-                    // Take the minimum.
-                    heuristics[index + pattern.array_offset] = heuristic;
-                }
+/*
+ * Starts the given phase of the search ps on every thread and, unless it is
+ * FINISHED, works on it until every thread is done.
+ */
+void run_phase(pattern_search *ps, enum phase phase)
+{
+    pthread_mutex_lock(&ps->lock);
+    ps->phase = phase;
+    atomic_store(&ps->expanded, 0);
+    atomic_store(&ps->next_block, 0);
+    ps->num_working = ps->num_threads;
+    ps->phase_number++;
+    pthread_cond_broadcast(&ps->started);
+    pthread_mutex_unlock(&ps->lock);
+    if (phase == FINISHED)
+    {
+        return;
+    }
 
-                // Finally undo the move in preparation for the next move.
-                n->board[move_index] = tile;
-                n->board[n->empty_index] = 0;
-            }
+    work_on_phase(ps);
+    pthread_mutex_lock(&ps->lock);
+    ps->num_working--;
+    while (ps->num_working)
+    {
+        pthread_cond_wait(&ps->finished, &ps->lock);
+    }
+    pthread_mutex_unlock(&ps->lock);
+}
+
+/*
+ * The work of each thread of the search of a pattern besides the one
+ * coordinating it. Works on each phase of the search as it starts.
+ */
+void *search_blocks(void *arg)
+{
+    pattern_search *ps = arg;
+    int phase_number = 0;
+    pthread_mutex_lock(&ps->lock);
+    while (true)
+    {
+        while (ps->phase_number == phase_number)
+        {
+            pthread_cond_wait(&ps->started, &ps->lock);
+        }
+        phase_number = ps->phase_number;
+        if (ps->phase == FINISHED)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&ps->lock);
+
+        work_on_phase(ps);
+
+        pthread_mutex_lock(&ps->lock);
+        ps->num_working--;
+        if (!ps->num_working)
+        {
+            pthread_cond_signal(&ps->finished);
         }
-        free(n);
     }
-    free(visited);
-    return true;
+    pthread_mutex_unlock(&ps->lock);
+    return NULL;
 }
 
 /*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
+ * Takes blocks of the current phase of the search ps and works on them until
+ * there are none left.
  */
-int arr_index(uint8_t board[DIM4_NUM_TILES], tile_pattern pattern)
+void work_on_phase(pattern_search *ps)
 {
-    int index = 0;
-    int k = 1;
-    for (int i = 0; i < pattern.num_tiles; i++)
+    int64_t states = ps->visited_states;
+    int64_t expanded = 0;
+    int64_t block;
+    while ((block = atomic_fetch_add(&ps->next_block, 1)) < ps->num_blocks)
     {
-        for (int j = 0; j < DIM4_NUM_TILES; j++)
+        int64_t start = block * ps->block_states;
+        int64_t end = start + ps->block_states < states
+                      ? start + ps->block_states
+                      : states;
+        expanded += sweep_block(ps, start, end);
+    }
+    atomic_fetch_add(&ps->expanded, expanded);
+}
+
+/*
+ * Closes and expands each open state of the current cost from start up to end
+ * of the visited array of the search ps. Returns the number of states
+ * expanded.
+ */
+int64_t sweep_block(pattern_search *ps, int64_t start, int64_t end)
+{
+    int cost = ps->cost;
+    int open = OPEN_STATE(cost);
+    int64_t expanded = 0;
+    for (int64_t byte = start / STATES_PER_BYTE;
+         byte < (end + STATES_PER_BYTE - 1) / STATES_PER_BYTE; byte++)
+    {
+        // Skip over bytes with no open states of the current cost. Flipping
+        // the bits of open leaves such states, and only them, with both bits
+        // set.
+        unsigned char value = atomic_load_explicit(&ps->visited[byte],
+                                                   memory_order_relaxed);
+        unsigned char flipped = value ^ (0xFF & ~(open * 0x55));
+        if (!(flipped & (flipped >> 1) & 0x55))
+        {
+            continue;
+        }
+
+        // Another thread may open other states in the same byte at the same
+        // time, so close each state only if it is still open. The trailing
+        // states of the last byte are never reached.
+        for (int64_t index = byte * STATES_PER_BYTE;
+             index < (byte + 1) * STATES_PER_BYTE; index++)
         {
-            if (pattern.tiles[i] == board[j])
+            if (change_state(ps->visited, index, open, CLOSED))
             {
-                index += j * k;
-                k *= DIM4_NUM_TILES;
+                expand_region(ps, index, cost);
+                expanded++;
             }
         }
     }
-    return index;
+    return expanded;
 }
 
 /*
- * Takes a node and adds it to the back of the queue.
+ * Makes every move of a tile in the pattern into the region of the closed
+ * state at the given index of the visited array of the search ps, opening
+ * each state reached at the next cost. Records the cost as the heuristic
+ * value of the arrangement of the pattern's tiles unless it already has one.
  */
-void enqueue(node *n, node **front, node **back)
+void expand_region(pattern_search *ps, int64_t index, int cost)
 {
-    if (*front == NULL)
+    // The locations of the pattern's tiles followed by that of the empty tile,
+    // and the region the empty tile may move around.
+    int num_tiles = ps->pattern.num_tiles;
+    int locations[DIM4_NUM_TILES + 1];
+    index_locations(index, num_tiles + 1, COMPACT_LAYOUT, locations);
+    unsigned int taken = 0;
+    for (int i = 0; i < num_tiles; i++)
+    {
+        taken |= 1u << locations[i];
+    }
+    unsigned int region = fill_region(1u << locations[num_tiles],
+                                      ~taken & 0xFFFF);
+
+    // The states of an arrangement of the pattern's tiles are together, in a
+    // single block, so only this thread may be recording its heuristic value.
+    // The first region closed has the least cost.
+    int64_t heuristic_index = 0;
+    if (ps->layout == COMPACT_LAYOUT)
     {
-        n->next = NULL;
-        *front = n;
-        *back = n;
+        heuristic_index = index / (DIM4_NUM_TILES - num_tiles);
     }
     else
     {
-        (*back)->next = n;
-        n->next = NULL;
-        *back = n;
+        for (int i = 0; i < num_tiles; i++)
+        {
+            heuristic_index += (int64_t) locations[i] << (4 * i);
+        }
+    }
+    if (ps->heuristics[heuristic_index] == UINT8_MAX)
+    {
+        ps->heuristics[heuristic_index] = cost;
+    }
+
+    // Move each tile of the pattern next to the region into each location of
+    // the region next to it, leaving the empty tile where the tile was.
+    for (int i = 0; i < num_tiles; i++)
+    {
+        int from = locations[i];
+        unsigned int destinations = neighbouring_cells(1u << from) & region;
+        while (destinations)
+        {
+            int to = __builtin_ctz(destinations);
+            destinations &= destinations - 1;
+
+            // Make the move, then undo it later.
+            unsigned int moved_taken = taken ^ (1u << from) ^ (1u << to);
+            locations[i] = to;
+            locations[num_tiles] = __builtin_ctz(
+                fill_region(1u << from, ~moved_taken & 0xFFFF));
+            change_state(ps->visited,
+                         compact_index(locations, num_tiles + 1), UNVISITED,
+                         OPEN_STATE(cost + 1));
+            locations[i] = from;
+        }
     }
 }
 
 /*
- * Removes and returns a node from the front of the queue.
+ * Returns the cells, given as a bit set of locations, which are next to any of
+ * the given cells.
+ */
+unsigned int neighbouring_cells(unsigned int cells)
+{
+    // Moving left or right must not wrap around onto another row.
+    return ((cells << DIM4) & 0xFFFF) | (cells >> DIM4)
+           | ((cells << 1) & ~LEFT_COLUMN & 0xFFFF)
+           | ((cells >> 1) & ~RIGHT_COLUMN);
+}
+
+/*
+ * Returns the region of the given unoccupied cells which may be reached from
+ * the given cells, as bit sets of locations, by moving only between
+ * unoccupied cells next to one another.
  */
-node *dequeue(node **front)
+unsigned int fill_region(unsigned int cells, unsigned int unoccupied)
 {
-    if (*front != NULL)
+    unsigned int region;
+    do
     {
-        node *ptr = *front;
-        *front = (*front)->next;
-        return ptr;
+        region = cells;
+        cells = (region | neighbouring_cells(region)) & unoccupied;
     }
-    else
+    while (cells != region);
+    return region;
+}
+
+/*
+ * Changes the state at the given index of a visited array from one value to
+ * another, returning false if its value was not from.
+ */
+bool change_state(atomic_uchar visited[], int64_t index, int from, int to)
+{
+    // The other states in the same byte may be changed by other threads.
+    atomic_uchar *byte = &visited[index / STATES_PER_BYTE];
+    int shift = 2 * (index % STATES_PER_BYTE);
+    unsigned char value = atomic_load_explicit(byte, memory_order_relaxed);
+    do
     {
-        return NULL;
+        if (((value >> shift) & 3) != from)
+        {
+            return false;
+        }
     }
+    while (!atomic_compare_exchange_weak_explicit(
+               byte, &value, (value & ~(3 << shift)) | (to << shift),
+               memory_order_relaxed, memory_order_relaxed));
+    return true;
 }
-
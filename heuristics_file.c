@@ -0,0 +1,275 @@
+/**
+ * heuristics_file.c
+ *
+ * This file reads and writes the header at the start of the solvers' data
+ * files, see heuristics_file.h.
+ *
+ * Without a header a data file was only known by its size, so a database
+ * generated for a different partition of the same size, or one cut short or
+ * otherwise damaged, would be used silently giving wrong solutions. The
+ * header records what the data is and how it is laid out, and a checksum of
+ * the data. The header is checked whenever the file is loaded, but as the
+ * checksum needs the whole file to be read it is only checked when asked,
+ * see map_heuristics_file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heuristics_file.h"
+#include "map_file.h"
+
+// The checksum is computed over this many interleaved words at a time, so
+// that the multiplications of each word don't have to wait on one another.
+#define CHECKSUM_LANES 4
+
+// Added to the name of a file whilst it is being written.
+#define TEMPORARY_SUFFIX ".tmp"
+
+// The offset basis and prime of the 64 bit FNV-1a hash.
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+ * Fills in the header for data of the given kind and length, with no
+ * patterns, ready to be written by write_heuristics_file.
+ */
+void init_heuristics_header(heuristics_header *header,
+                            enum heuristics_kind kind, uint64_t length)
+{
+    // Clear every byte, so that files with the same data are identical.
+    memset(header, 0, sizeof(heuristics_header));
+    memcpy(header->magic, HEURISTICS_MAGIC, sizeof(HEURISTICS_MAGIC));
+    header->version = HEURISTICS_VERSION;
+    header->kind = kind;
+    header->length = length;
+}
+
+/*
+ * Fills in the header for the heuristic values of the given partition saved in
+ * the given layout, packed or not.
+ */
+void init_dim4_header(heuristics_header *header, const partition *partition,
+                      enum layout layout, bool packed)
+{
+    uint64_t length = layout == COMPACT_LAYOUT
+                      ? partition->compact_total_states
+                      : partition->total_states;
+    init_heuristics_header(header, DIM4_HEURISTICS,
+                           packed ? PACKED_LENGTH(length) : length);
+    header->layout = layout;
+    header->packed = packed;
+    header->num_patterns = partition->num_patterns;
+    for (int i = 0; i < partition->num_patterns; i++)
+    {
+        const tile_pattern *pattern = &partition->patterns[i];
+        header->num_tiles[i] = pattern->num_tiles;
+        for (int j = 0; j < pattern->num_tiles; j++)
+        {
+            header->tiles[i][j] = pattern->tiles[j];
+        }
+        header->offsets[i] = layout == COMPACT_LAYOUT
+                             ? pattern->compact_array_offset
+                             : pattern->array_offset;
+    }
+}
+
+/*
+ * Returns true if the header describes the heuristic values of the given
+ * partition, with the same patterns of tiles in the same order and of the
+ * right length for its layout and packing.
+ */
+bool header_matches_partition(const heuristics_header *header,
+                              const partition *partition)
+{
+    if (header->kind != DIM4_HEURISTICS || header->packed > 1
+        || (header->layout != SPARSE_LAYOUT
+            && header->layout != COMPACT_LAYOUT)
+        || (header->layout == SPARSE_LAYOUT && !partition->total_states))
+    {
+        return false;
+    }
+    heuristics_header expected;
+    init_dim4_header(&expected, partition, header->layout, header->packed);
+    return header->length == expected.length
+           && header->num_patterns == expected.num_patterns
+           && memcmp(header->num_tiles, expected.num_tiles,
+                     sizeof(expected.num_tiles)) == 0
+           && memcmp(header->tiles, expected.tiles,
+                     sizeof(expected.tiles)) == 0
+           && memcmp(header->offsets, expected.offsets,
+                     sizeof(expected.offsets)) == 0;
+}
+
+/*
+ * Fills in the header for the heuristic values of the given pattern saved in
+ * the given layout, in data of the given kind and length, and the index in
+ * its partition's database of the pattern's first value.
+ */
+void init_pattern_header(heuristics_header *header, enum heuristics_kind kind,
+                         const tile_pattern *pattern, enum layout layout,
+                         uint64_t length)
+{
+    init_heuristics_header(header, kind, length);
+    header->layout = layout;
+    header->num_patterns = 1;
+    header->num_tiles[0] = pattern->num_tiles;
+    for (int j = 0; j < pattern->num_tiles; j++)
+    {
+        header->tiles[0][j] = pattern->tiles[j];
+    }
+    header->offsets[0] = layout == COMPACT_LAYOUT
+                         ? pattern->compact_array_offset
+                         : pattern->array_offset;
+}
+
+/*
+ * Returns true if the header describes data of the given kind and length for
+ * the given pattern saved in the given layout.
+ */
+bool header_matches_pattern(const heuristics_header *header,
+                            enum heuristics_kind kind,
+                            const tile_pattern *pattern, enum layout layout,
+                            uint64_t length)
+{
+    heuristics_header expected;
+    init_pattern_header(&expected, kind, pattern, layout, length);
+    return header->kind == expected.kind && header->layout == expected.layout
+           && header->packed == expected.packed
+           && header->length == expected.length
+           && header->num_patterns == expected.num_patterns
+           && memcmp(header->num_tiles, expected.num_tiles,
+                     sizeof(expected.num_tiles)) == 0
+           && memcmp(header->tiles, expected.tiles,
+                     sizeof(expected.tiles)) == 0
+           && header->offsets[0] == expected.offsets[0];
+}
+
+/*
+ * Writes the header, with the checksum of data filled in, followed by the
+ * length bytes of data given in the header to the named file. The file is
+ * only replaced once it is completely written. Returns false upon any error.
+ */
+bool write_heuristics_file(const char *filename, heuristics_header *header,
+                           const uint8_t data[])
+{
+    header->checksum = heuristics_checksum(data, header->length);
+
+    // The header is padded out to a whole page.
+    uint8_t page[HEURISTICS_HEADER_SIZE] = {0};
+    memcpy(page, header, sizeof(heuristics_header));
+
+    // Write to a temporary file first, so that a program stopped part way
+    // through leaves any previous file whole.
+    char *temporary = malloc(strlen(filename) + sizeof(TEMPORARY_SUFFIX));
+    if (!temporary)
+    {
+        return false;
+    }
+    strcpy(temporary, filename);
+    strcat(temporary, TEMPORARY_SUFFIX);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file)
+    {
+        free(temporary);
+        return false;
+    }
+    bool success = fwrite(page, sizeof(page), 1, file) == 1
+                   && fwrite(data, header->length, 1, file) == 1;
+    success = fclose(file) == 0 && success
+              && rename(temporary, filename) == 0;
+    if (!success)
+    {
+        remove(temporary);
+    }
+    free(temporary);
+    return success;
+}
+
+/*
+ * Maps the named file into memory, see map_file.h, and checks its header
+ * against the length of the file and, if verify, the checksum of its data.
+ * Verifying reads the whole file, so it is left to the programs generating
+ * the data unless the map policy includes verify. Copies the header to header
+ * and returns a pointer to the data, or returns NULL upon any error or if the
+ * file is not a data file of the given kind.
+ */
+const uint8_t *map_heuristics_file(const char *filename,
+                                   enum heuristics_kind kind, bool verify,
+                                   heuristics_header *header)
+{
+    size_t length;
+    const uint8_t *file = map_file(filename, &length);
+    if (!file)
+    {
+        return NULL;
+    }
+    if (length < HEURISTICS_HEADER_SIZE)
+    {
+        unmap_file(file, length);
+        return NULL;
+    }
+
+    memcpy(header, file, sizeof(heuristics_header));
+    const uint8_t *data = file + HEURISTICS_HEADER_SIZE;
+    if (memcmp(header->magic, HEURISTICS_MAGIC, sizeof(HEURISTICS_MAGIC)) != 0
+        || header->version != HEURISTICS_VERSION || header->kind != kind
+        || header->length != length - HEURISTICS_HEADER_SIZE
+        || (verify
+            && header->checksum != heuristics_checksum(data, header->length)))
+    {
+        unmap_file(file, length);
+        return NULL;
+    }
+    return data;
+}
+
+/*
+ * Unmaps data of the given length previously returned by map_heuristics_file.
+ */
+void unmap_heuristics_file(const uint8_t *data, uint64_t length)
+{
+    if (data)
+    {
+        unmap_file(data - HEURISTICS_HEADER_SIZE,
+                   length + HEURISTICS_HEADER_SIZE);
+    }
+}
+
+/*
+ * Returns a checksum of the given bytes, which changes with any change of a
+ * single byte and almost surely with any other damage to them.
+ */
+uint64_t heuristics_checksum(const uint8_t data[], uint64_t length)
+{
+    // An FNV-1a hash of each lane of 8 byte words, then of the lanes and any
+    // bytes left over.
+    uint64_t lanes[CHECKSUM_LANES];
+    for (int j = 0; j < CHECKSUM_LANES; j++)
+    {
+        lanes[j] = FNV_OFFSET_BASIS;
+    }
+    uint64_t i = 0;
+    for (; i + CHECKSUM_LANES * 8 <= length; i += CHECKSUM_LANES * 8)
+    {
+        for (int j = 0; j < CHECKSUM_LANES; j++)
+        {
+            uint64_t word;
+            memcpy(&word, &data[i + 8 * j], 8);
+            lanes[j] = (lanes[j] ^ word) * FNV_PRIME;
+        }
+    }
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (int j = 0; j < CHECKSUM_LANES; j++)
+    {
+        hash = (hash ^ lanes[j]) * FNV_PRIME;
+    }
+    for (; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
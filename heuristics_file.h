@@ -0,0 +1,125 @@
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dim4.h"
+
+#ifndef HEURISTICS_FILE_H
+#define HEURISTICS_FILE_H
+
+// Every data file of the solvers, the 3x3 solutions and the 4x4 heuristics,
+// starts with a header of HEURISTICS_HEADER_SIZE bytes describing the data
+// which follows it. The header fills a whole page, so that the data remains
+// page aligned when the file is mapped into memory and can be used in place.
+#define HEURISTICS_MAGIC "FIFTEEN"
+#define HEURISTICS_VERSION 1
+#define HEURISTICS_HEADER_SIZE 4096
+
+// What the data of a file holds. Whilst a 4x4 database is being generated the
+// heuristic values of each pattern are saved in a slice of their own, and the
+// search of a pattern may be saved in a checkpoint, see
+// generate_dim4_heuristics.c.
+enum heuristics_kind
+{
+    DIM3_SOLUTIONS = 1,
+    DIM4_HEURISTICS = 2,
+    DIM4_SLICE = 3,
+    DIM4_CHECKPOINT = 4
+};
+
+// The header of a data file, saved in the byte order of the machine writing
+// it, which the magic and version guard against. For 4x4 heuristics it gives
+// the layout and packing of the values and the tiles of each pattern of the
+// partition, in order, with the index of the first value of each pattern.
+// Slices and checkpoints give a single pattern, and checkpoints the cost of
+// the level of the search to be resumed. The checksum is of the length bytes
+// of data, see heuristics_checksum.
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t layout;
+    uint32_t packed;
+    uint32_t num_patterns;
+    uint8_t num_tiles[MAX_PATTERNS];
+    uint8_t tiles[MAX_PATTERNS][DIM4_NUM_TILES];
+    uint32_t level;
+    uint64_t offsets[MAX_PATTERNS];
+    uint64_t length;
+    uint64_t checksum;
+}
+heuristics_header;
+
+/*
+ * Fills in the header for data of the given kind and length, with no
+ * patterns, ready to be written by write_heuristics_file.
+ */
+void init_heuristics_header(heuristics_header *header,
+                            enum heuristics_kind kind, uint64_t length);
+
+/*
+ * Fills in the header for the heuristic values of the given partition saved in
+ * the given layout, packed or not.
+ */
+void init_dim4_header(heuristics_header *header, const partition *partition,
+                      enum layout layout, bool packed);
+
+/*
+ * Returns true if the header describes the heuristic values of the given
+ * partition, with the same patterns of tiles in the same order and of the
+ * right length for its layout and packing.
+ */
+bool header_matches_partition(const heuristics_header *header,
+                              const partition *partition);
+
+/*
+ * Fills in the header for the heuristic values of the given pattern saved in
+ * the given layout, in data of the given kind and length, and the index in
+ * its partition's database of the pattern's first value.
+ */
+void init_pattern_header(heuristics_header *header, enum heuristics_kind kind,
+                         const tile_pattern *pattern, enum layout layout,
+                         uint64_t length);
+
+/*
+ * Returns true if the header describes data of the given kind and length for
+ * the given pattern saved in the given layout.
+ */
+bool header_matches_pattern(const heuristics_header *header,
+                            enum heuristics_kind kind,
+                            const tile_pattern *pattern, enum layout layout,
+                            uint64_t length);
+
+/*
+ * Writes the header, with the checksum of data filled in, followed by the
+ * length bytes of data given in the header to the named file. The file is
+ * only replaced once it is completely written. Returns false upon any error.
+ */
+bool write_heuristics_file(const char *filename, heuristics_header *header,
+                           const uint8_t data[]);
+
+/*
+ * Maps the named file into memory, see map_file.h, and checks its header
+ * against the length of the file and, if verify, the checksum of its data.
+ * Verifying reads the whole file, so it is left to the programs generating
+ * the data unless the map policy includes verify. Copies the header to header
+ * and returns a pointer to the data, or returns NULL upon any error or if the
+ * file is not a data file of the given kind.
+ */
+const uint8_t *map_heuristics_file(const char *filename,
+                                   enum heuristics_kind kind, bool verify,
+                                   heuristics_header *header);
+
+/*
+ * Unmaps data of the given length previously returned by map_heuristics_file.
+ */
+void unmap_heuristics_file(const uint8_t *data, uint64_t length);
+
+/*
+ * Returns a checksum of the given bytes, which changes with any change of a
+ * single byte and almost surely with any other damage to them.
+ */
+uint64_t heuristics_checksum(const uint8_t data[], uint64_t length);
+
+#endif
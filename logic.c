@@ -18,17 +18,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dim3_solver.h"
+#include "dim4_solver.h"
 #include "fifteen.h"
 
-/*
- * Some constants used by the optimal solver for 3x3 puzzles.
- */
-#define DIM3_NUM_TILES 9
-// There are 9! = 362,880 permutations of tiles numbered 0 to 8, (only half of
-// which will actually be valid states of the puzzle board).
-#define DIM3_NUM_BOARDS 362880
-#define DIM3_SOLUTIONS_FILE "dim3_solutions.bin"
-
 /*
  * Swaps the contents of array[i] and array[j], increments a swap counter.
  */
@@ -81,6 +74,24 @@ void quicksort(int array[], int low, int high, int *swap_count)
     return;
 }
 
+/*
+ * Moves the tile at the given row and column into the empty tile's location,
+ * keeping the tile positions up to date.
+ */
+void move_to_empty(int tile_row, int tile_col)
+{
+    int tile = p.board[tile_row][tile_col];
+    p.board[p.empty_row][p.empty_col] = tile;
+    p.board[tile_row][tile_col] = 0;
+    p.tile_row[tile] = p.empty_row;
+    p.tile_col[tile] = p.empty_col;
+    p.tile_row[0] = tile_row;
+    p.tile_col[0] = tile_col;
+    p.empty_row = tile_row;
+    p.empty_col = tile_col;
+    p.move_number++;
+}
+
 /*
  * Initializes the game's data. The tiles are produced using either a
  * psuedo-random ordering, the standard ordering or some custom orderings for
@@ -226,6 +237,16 @@ void init(char *type)
             p.board[1][0] = temp;
         }
     }
+
+    // Record where each tile is located.
+    for (int row = 0; row < p.dim; row++)
+    {
+        for (int col = 0; col < p.dim; col++)
+        {
+            p.tile_row[p.board[row][col]] = row;
+            p.tile_col[p.board[row][col]] = col;
+        }
+    }
 }
 
 /*
@@ -238,44 +259,28 @@ void slide(char direction)
         case 'l':
             if (p.empty_col < p.dim - 1)
             {
-                int tile = p.board[p.empty_row][p.empty_col + 1];
-                p.board[p.empty_row][p.empty_col] = tile;
-                p.board[p.empty_row][p.empty_col + 1] = 0;
-                p.empty_col++;
-                p.move_number++;
+                move_to_empty(p.empty_row, p.empty_col + 1);
             }
             break;
 
         case 'r':
             if (p.empty_col > 0)
             {
-                int tile = p.board[p.empty_row][p.empty_col - 1];
-                p.board[p.empty_row][p.empty_col] = tile;
-                p.board[p.empty_row][p.empty_col - 1] = 0;
-                p.empty_col--;
-                p.move_number++;
+                move_to_empty(p.empty_row, p.empty_col - 1);
             }
             break;
 
         case 'u':
             if (p.empty_row < p.dim - 1)
             {
-                int tile = p.board[p.empty_row + 1][p.empty_col];
-                p.board[p.empty_row][p.empty_col] = tile;
-                p.board[p.empty_row + 1][p.empty_col] = 0;
-                p.empty_row++;
-                p.move_number++;
+                move_to_empty(p.empty_row + 1, p.empty_col);
             }
             break;
 
         case 'd':
             if (p.empty_row > 0)
             {
-                int tile = p.board[p.empty_row - 1][p.empty_col];
-                p.board[p.empty_row][p.empty_col] = tile;
-                p.board[p.empty_row - 1][p.empty_col] = 0;
-                p.empty_row--;
-                p.move_number++;
+                move_to_empty(p.empty_row - 1, p.empty_col);
             }
             break;
     }
@@ -294,52 +299,16 @@ void slide(char direction)
  */
 void slide_tile(int tile)
 {
-    // Determine the location of the tile.
-    int tile_row = -1;
-    int tile_col = -1;
-
-    if (p.empty_col < p.dim - 1)
-    {
-        if (tile == p.board[p.empty_row][p.empty_col + 1])
-        {
-            tile_row = p.empty_row;
-            tile_col = p.empty_col + 1;
-        }
-    }
-    if (p.empty_col > 0)
-    {
-        if (tile == p.board[p.empty_row][p.empty_col - 1])
-        {
-            tile_row = p.empty_row;
-            tile_col = p.empty_col - 1;
-        }
-    }
-    if (p.empty_row < p.dim - 1)
+    // Providing the tile is adjacent to the empty tile, make the move.
+    if (tile > 0 && tile < p.dim * p.dim)
     {
-        if (tile == p.board[p.empty_row + 1][p.empty_col])
+        int tile_row = p.tile_row[tile];
+        int tile_col = p.tile_col[tile];
+        if (abs(tile_row - p.empty_row) + abs(tile_col - p.empty_col) == 1)
         {
-            tile_row = p.empty_row + 1;
-            tile_col = p.empty_col;
+            move_to_empty(tile_row, tile_col);
         }
     }
-    if (p.empty_row > 0)
-    {
-        if (tile == p.board[p.empty_row - 1][p.empty_col])
-        {
-            tile_row = p.empty_row - 1;
-            tile_col = p.empty_col;
-        }
-    }
-
-    // Providing we found the tile, make the move.
-    if (tile_row != -1 && tile_col != -1)
-    {
-        p.board[p.empty_row][p.empty_col] = tile;
-        p.board[tile_row][tile_col] = 0;
-        p.empty_row = tile_row;
-        p.empty_col = tile_col;
-        p.move_number++;
-    }
 
     // If using God mode, provide a pause between each move for animation.
     if (p.puzzle_state == GOD_MODE)
@@ -388,8 +357,8 @@ bool is_solved(void)
 int permuation_rank(void)
 {
     // A full explanation of how this function works is provided in
-    // generate_dim3_solutions.c. The only difference here is that the our
-    // puzzle board is a 2d array.
+    // dim3_solver.c. The only difference here is that the our puzzle board is
+    // a 2d array.
 
     // We require two auxillary arrays initialised as [0...8].
     int positions[DIM3_NUM_TILES];
@@ -426,40 +395,54 @@ int permuation_rank(void)
 }
 
 /*
- * Loads from DIM3_SOLUTIONS_FILE an array containing a solution graph for 3x3
- * puzzles and returns a pointer to that array. In case of any errors returns
- * NULL.
+ * Given an offset so that we can identify a the 4x4 lower right corner of the
+ * puzzle, and given a database of heuristic values, uses the optimal 4x4
+ * solver to arrange the 4x4 tiles correctly. Returns true on success.
+ * Otherwise returns false.
  */
-uint8_t *load_dim3_solutions(void)
+bool solve_dim4_corner(int board_offset, const pattern_database *database)
 {
-    uint8_t *dim3_array = malloc(DIM3_NUM_BOARDS);
-    if (!dim3_array)
+    // Read in the 4x4 lower right corner of the puzzle board and adjust the
+    // tile numbers to be in the range 1-15.
+    int board[DIM4_NUM_TILES];
+    int i = 0;
+    for (int row = board_offset; row < p.dim; row++)
     {
-        return NULL;
-    }
-
-    // Load 3x3 solutions data.
-    FILE *fp = fopen(DIM3_SOLUTIONS_FILE, "rb");
-    if (!fp)
-    {
-        if (dim3_array)
+        for (int col = board_offset; col < p.dim; col++)
         {
-            free(dim3_array);
+            board[i] = 0;
+            if (p.board[row][col] != 0)
+            {
+                int pos = p.board[row][col] - 1;
+                int adjusted_row = (pos / p.dim) - board_offset;
+                int adjusted_col = (pos % p.dim) - board_offset;
+                board[i] = (adjusted_row * DIM4) + adjusted_col + 1;
+            }
+            i++;
         }
-        return NULL;
     }
 
-    if (fread(dim3_array, DIM3_NUM_BOARDS, 1, fp) != 1)
+    dim4_context *context = create_dim4_context(database, 1, 0, true);
+    if (!context)
     {
-        if (dim3_array)
-        {
-            free(dim3_array);
-        }
-        fclose(fp);
-        return NULL;
+        return false;
+    }
+    uint8_t moves[DIM4_MAX_MOVES];
+    int num_moves = dim4_solver(context, board, moves);
+    free_dim4_context(context);
+
+    // The solution's tile moves are for tiles from 1 to 15. First locate the
+    // corresponding tile in the original puzzle according to the offset, then
+    // make the move for that tile.
+    for (int i = 0; i < num_moves; i++)
+    {
+        int adjusted_row = (moves[i] - 1) / DIM4;
+        int adjusted_col = (moves[i] - 1) % DIM4;
+        int tile = (adjusted_row + board_offset) * p.dim
+                   + (adjusted_col + board_offset) + 1;
+        slide_tile(tile);
     }
-    fclose(fp);
-    return dim3_array;
+    return num_moves != -1;
 }
 
 /*
@@ -467,7 +450,7 @@ uint8_t *load_dim3_solutions(void)
  * puzzle, calls a series of moves until the puzzle is solved. Returns true
  * upon success, false otherwise.
  */
-bool god_mode(uint8_t **dim3_array, uint8_t **dim4_array)
+bool god_mode(void)
 {
     // Reset the move counter to provide the number of moves the solver used.
     p.move_number = 0;
@@ -501,13 +484,10 @@ bool god_mode(uint8_t **dim3_array, uint8_t **dim4_array)
     // Try and use the optimal solver for the 3x3 case.
     else if (p.dim == 3)
     {
-        // Check whether we have already loaded solutions for 3x3 puzzles.
-        if (!*dim3_array)
-        {
-            *dim3_array = load_dim3_solutions();
-        }
-
-        if (*dim3_array)
+        // Get the solutions for 3x3 puzzles, waiting for them to be built
+        // unless that has already been done.
+        const uint8_t *dim3_array = build_dim3_solutions();
+        if (dim3_array)
         {
             // If successful, determine an index into the array by producing a
             // rank number based on the board's current tile arrangment. Then
@@ -515,7 +495,7 @@ bool god_mode(uint8_t **dim3_array, uint8_t **dim4_array)
             // array at that index. Continue until we reach the sentinel value
             // which corresponds to the solved board.
             int tile;
-            while ((tile = (*dim3_array)[permuation_rank()]) != DIM3_NUM_TILES)
+            while ((tile = dim3_array[permuation_rank()]) != DIM3_NUM_TILES)
             {
                 slide_tile(tile);
             }
@@ -535,25 +515,24 @@ bool god_mode(uint8_t **dim3_array, uint8_t **dim4_array)
             // If we are in a position to use the 4x4 optimal solver.
             if (p.dim - offset == 4)
             {
-                // Check whether we have already loaded heuristics for 4x4
-                // puzzles.
-                if (!*dim4_array)
+                // Load the heuristics for 4x4 puzzles, unless they have
+                // already been loaded. Without them the solver can still use
+                // the walking distance, which is built in memory.
+                const pattern_database *database
+                    = load_shared_dim4_heuristics();
+                if (!database)
                 {
-                    *dim4_array = load_dim4_heuristics();
+                    database = build_dim4_walking_distance();
                 }
 
-                // If so, use the 4x4 optimal solver on the unsolved
-                // lower-right 4x4 corner of the board.
-                if (*dim4_array)
-                {
-                    // Display a message in case the solver takes a long time.
-                    p.puzzle_state = BUSY;
-                    draw_board();
-                    refresh();
-                    p.puzzle_state = GOD_MODE;
-                    // Call the solver.
-                    dim4_solver(offset, *dim4_array);
-                }
+                // Use the 4x4 optimal solver on the unsolved lower-right 4x4
+                // corner of the board. Display a message in case the solver
+                // takes a long time.
+                p.puzzle_state = BUSY;
+                draw_board();
+                refresh();
+                p.puzzle_state = GOD_MODE;
+                solve_dim4_corner(offset, database);
 
                 // Check for success.
                 if (is_solved())
@@ -0,0 +1,206 @@
+/**
+ * map_file.c
+ *
+ * This file implements the loading of the solvers' data files, such as the 4x4
+ * heuristics database and the 3x3 solutions, by mapping them into memory.
+ *
+ * Reading a 33.5MB database into a malloc'd array means every process pays
+ * for reading the whole file before its first lookup and holds its own copy.
+ * Instead we map the file read-only. Lookups can begin immediately whilst the
+ * kernel reads the file in, and the pages are shared through the page cache
+ * by every process using the file.
+ *
+ * Lookups into a heuristics database are essentially random, so for large
+ * tables a significant cost is TLB misses. Optionally the data can be copied
+ * into memory backed by transparent huge pages which need far fewer TLB
+ * entries, see MAP_POLICY_ENV in map_file.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "map_file.h"
+
+// The size of a transparent huge page on x86-64 and most other platforms.
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/*
+ * Returns true if the comma separated list of options includes option.
+ */
+static bool has_option(const char *options, const char *option);
+
+/*
+ * Reads length bytes from the file descriptor fd into memory backed by
+ * transparent huge pages. Returns a pointer to the read-only data or NULL
+ * upon any error.
+ */
+static const uint8_t *read_into_huge_pages(int fd, size_t length);
+
+/*
+ * Maps the whole of the named file read-only into memory using the policy
+ * given by MAP_POLICY_ENV. The mapping is shared with any other process
+ * mapping the same file, unless huge pages are used. Returns a pointer to the
+ * data and sets *length to its length, or returns NULL upon any error.
+ */
+const uint8_t *map_file(const char *filename, size_t *length)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+
+    const uint8_t *data = NULL;
+    if (map_policy_includes("hugepages"))
+    {
+        data = read_into_huge_pages(fd, *length);
+    }
+
+    // Map the file itself, either as the chosen policy or as a fall back
+    // should huge pages not be available.
+    if (!data)
+    {
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (map_policy_includes("populate"))
+        {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        void *addr = mmap(NULL, *length, PROT_READ, flags, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            data = addr;
+        }
+    }
+    close(fd);
+    if (!data)
+    {
+        return NULL;
+    }
+
+    // Advice to the kernel is only a hint so errors are ignored.
+    if (map_policy_includes("random"))
+    {
+        madvise((void *) data, *length, MADV_RANDOM);
+    }
+    if (map_policy_includes("willneed"))
+    {
+        madvise((void *) data, *length, MADV_WILLNEED);
+    }
+
+    return data;
+}
+
+/*
+ * Unmaps data of the given length previously returned by map_file.
+ */
+void unmap_file(const uint8_t *data, size_t length)
+{
+    if (data)
+    {
+        munmap((void *) data, length);
+    }
+}
+
+/*
+ * Returns true if the policy given by MAP_POLICY_ENV, or the default policy if
+ * it is not set, includes the given option.
+ */
+bool map_policy_includes(const char *option)
+{
+    const char *policy = getenv(MAP_POLICY_ENV);
+    return has_option(policy ? policy : MAP_POLICY_DEFAULT, option);
+}
+
+/*
+ * Returns true if the comma separated list of options includes option.
+ */
+static bool has_option(const char *options, const char *option)
+{
+    size_t len = strlen(option);
+    const char *p = options;
+    while ((p = strstr(p, option)))
+    {
+        if ((p == options || p[-1] == ',') && (p[len] == ',' || !p[len]))
+        {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
+
+/*
+ * Reads length bytes from the file descriptor fd into memory backed by
+ * transparent huge pages. Returns a pointer to the read-only data or NULL
+ * upon any error.
+ */
+static const uint8_t *read_into_huge_pages(int fd, size_t length)
+{
+#ifdef MADV_HUGEPAGE
+    // Reserve enough anonymous memory that we can trim it to start on a huge
+    // page boundary.
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t mapped_length = (length + page_size - 1) / page_size * page_size;
+    size_t reserved_length = mapped_length + HUGE_PAGE_SIZE;
+    uint8_t *reserved = mmap(NULL, reserved_length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        return NULL;
+    }
+    uintptr_t start = ((uintptr_t) reserved + HUGE_PAGE_SIZE - 1)
+                      & ~((uintptr_t) HUGE_PAGE_SIZE - 1);
+    uint8_t *data = (uint8_t *) start;
+    if (data > reserved)
+    {
+        munmap(reserved, data - reserved);
+    }
+    if (reserved + reserved_length > data + mapped_length)
+    {
+        munmap(data + mapped_length,
+               reserved + reserved_length - (data + mapped_length));
+    }
+
+    // Ask for huge pages before the memory is first touched.
+    if (madvise(data, mapped_length, MADV_HUGEPAGE) == -1)
+    {
+        munmap(data, mapped_length);
+        return NULL;
+    }
+
+    size_t total = 0;
+    while (total < length)
+    {
+        ssize_t n = pread(fd, data + total, length - total, total);
+        if (n <= 0)
+        {
+            munmap(data, mapped_length);
+            return NULL;
+        }
+        total += n;
+    }
+
+    mprotect(data, mapped_length, PROT_READ);
+    return data;
+#else
+    (void) fd;
+    (void) length;
+    return NULL;
+#endif
+}
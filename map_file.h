@@ -0,0 +1,41 @@
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+// The environment variable which selects how data files are mapped into
+// memory. It holds a comma separated list of the following options:
+//   populate  - read the whole file in before returning, (MAP_POPULATE).
+//   willneed  - start reading the whole file in the background, the default.
+//   random    - expect random lookups so don't read ahead of each lookup.
+//   hugepages - copy the file into memory backed by transparent huge pages,
+//               reducing TLB misses at the cost of a private copy per process.
+//   verify    - check the checksum of a database as it is loaded, which means
+//               reading the whole file in first, see map_heuristics_file.
+// For example FIFTEEN_MAP_POLICY=random,hugepages
+#define MAP_POLICY_ENV "FIFTEEN_MAP_POLICY"
+#define MAP_POLICY_DEFAULT "willneed"
+
+/*
+ * Maps the whole of the named file read-only into memory using the policy
+ * given by MAP_POLICY_ENV. The mapping is shared with any other process
+ * mapping the same file, unless huge pages are used. Returns a pointer to the
+ * data and sets *length to its length, or returns NULL upon any error.
+ */
+const uint8_t *map_file(const char *filename, size_t *length);
+
+/*
+ * Unmaps data of the given length previously returned by map_file.
+ */
+void unmap_file(const uint8_t *data, size_t length);
+
+/*
+ * Returns true if the policy given by MAP_POLICY_ENV, or the default policy if
+ * it is not set, includes the given option.
+ */
+bool map_policy_includes(const char *option);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * merge_dim4_heuristics.c
+ *
+ * This program merges the slices of the heuristic values of each pattern of a
+ * partition, saved by generate_dim4_heuristics with the option -s, into the
+ * database of the partition which the solvers load. The slices are removed
+ * once the database is written.
+ *
+ * The partition is chosen as for generate_dim4_heuristics, with -p by name
+ * from DIM4_PARTITIONS_FILE or, with -f, from another file, and -c must be
+ * given if the slices were generated in the compact layout. With -n the
+ * database is packed into half the space, see generate_dim4_heuristics.c.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dim4.h"
+#include "dim4_database.h"
+#include "dim4_partitions.h"
+
+
+int main(int argc, char *argv[])
+{
+    const char *filename = DIM4_PARTITIONS_FILE;
+    const char *name = NULL;
+    enum layout layout = SPARSE_LAYOUT;
+    bool packed = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "cf:np:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                layout = COMPACT_LAYOUT;
+                break;
+            case 'f':
+                filename = optarg;
+                break;
+            case 'n':
+                packed = true;
+                break;
+            case 'p':
+                name = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c] [-n] [-f partitions_file] "
+                        "[-p partition]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    partition partitions[MAX_PARTITIONS];
+    char error[PARTITIONS_ERROR_CHARS];
+    int num_partitions = read_dim4_partitions(filename, partitions, error);
+    if (num_partitions == -1)
+    {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    const partition *partition = name ? NULL : &partitions[0];
+    for (int i = 0; name && i < num_partitions; i++)
+    {
+        if (strcmp(name, partitions[i].name) == 0)
+        {
+            partition = &partitions[i];
+        }
+    }
+    if (!partition)
+    {
+        fprintf(stderr, "No partition %s is declared in %s\n", name,
+                filename);
+        return 1;
+    }
+
+    // Partitions with large patterns are only saved in the compact layout.
+    if (partition->total_states == 0)
+    {
+        layout = COMPACT_LAYOUT;
+    }
+
+    char database_error[DATABASE_ERROR_CHARS];
+    if (!merge_dim4_slices(partition, layout, packed, database_error))
+    {
+        fprintf(stderr, "%s\n", database_error);
+        return 1;
+    }
+    printf("Merged the slices of %s into %s\n", partition->name,
+           partition->file);
+    return 0;
+}
@@ -0,0 +1,321 @@
+/**
+ * select_dim4_partitions.c
+ *
+ * This program compares partitions of the tiles into patterns for the 4x4
+ * heuristics on a sample of puzzles read from stdin, one per line in the same
+ * format as for standalone_dim4_solver, so that the databases used can be
+ * chosen to suit the puzzles actually being solved.
+ *
+ * The partitions are read from DIM4_PARTITIONS_FILE or, with -f, from another
+ * file of candidates in the same format, and each must already have had its
+ * database generated by generate_dim4_heuristics. As the solvers take the
+ * largest heuristic of every database they load, every combination of the
+ * partitions is tried whose databases together take no more than the number
+ * of megabytes given with -m. For each combination the program reports the
+ * mean heuristic value of the puzzles, the mean number of nodes expanded
+ * solving them and the time taken, and finally picks the combination which
+ * expands the fewest nodes.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dim4.h"
+#include "dim4_partitions.h"
+#include "dim4_solver.h"
+
+// The number of bytes in a megabyte, the unit of the memory budget.
+#define MEGABYTE (1024 * 1024)
+
+// Enough characters for the names of the partitions of a combination.
+#define MAX_NAMES_CHARS (MAX_PARTITIONS * MAX_PARTITION_NAME)
+
+// The results of solving the sample puzzles with a combination of partitions.
+typedef struct
+{
+    double mean_heuristic;
+    double mean_nodes;
+    double seconds;
+}
+evaluation;
+
+/*
+ * Reads puzzles from stdin into a new array, saving their number in
+ * num_boards, and returns the array or NULL upon an error.
+ */
+int (*read_boards(long *num_boards))[DIM4_NUM_TILES];
+
+/*
+ * Solves each of the given boards using the database of the partitions in the
+ * given combination, a bit set of indices into partitions, and saves the
+ * results in result. Returns false upon an error.
+ */
+bool evaluate(const partition partitions[], unsigned int combination,
+              int (*boards)[DIM4_NUM_TILES], long num_boards,
+              evaluation *result);
+
+/*
+ * Writes the names of the partitions in the given combination, a bit set of
+ * indices into partitions, to names separated by '+'.
+ */
+void write_names(const partition partitions[], unsigned int combination,
+                 char names[MAX_NAMES_CHARS]);
+
+
+int main(int argc, char *argv[])
+{
+    const char *filename = DIM4_PARTITIONS_FILE;
+    // The most memory the databases may take together, by default any.
+    long budget_megabytes = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:m:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                filename = optarg;
+                break;
+            case 'm':
+                budget_megabytes = atol(optarg);
+                if (budget_megabytes > 0)
+                {
+                    break;
+                }
+                // Fall through.
+            default:
+                fprintf(stderr, "Usage: %s [-f partitions_file] "
+                        "[-m megabytes] < puzzles\n", argv[0]);
+                return 1;
+        }
+    }
+
+    partition partitions[MAX_PARTITIONS];
+    char error[PARTITIONS_ERROR_CHARS];
+    int num_partitions = read_dim4_partitions(filename, partitions, error);
+    if (num_partitions == -1)
+    {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    long num_boards;
+    int (*boards)[DIM4_NUM_TILES] = read_boards(&num_boards);
+    if (!boards)
+    {
+        return 1;
+    }
+    if (num_boards == 0)
+    {
+        fprintf(stderr, "No puzzles were read.\n");
+        free(boards);
+        return 1;
+    }
+
+    // Only partitions whose database can be loaded are compared.
+    unsigned int available = 0;
+    long long sizes[MAX_PARTITIONS];
+    for (int i = 0; i < num_partitions; i++)
+    {
+        struct stat file_stat;
+        pattern_database *database = load_dim4_partitions(&partitions[i], 1);
+        if (!database || stat(partitions[i].file, &file_stat) != 0)
+        {
+            fprintf(stderr, "Skipping %s, its database %s has not been "
+                    "generated.\n", partitions[i].name, partitions[i].file);
+        }
+        else
+        {
+            available |= 1u << i;
+            sizes[i] = file_stat.st_size;
+        }
+        if (database)
+        {
+            unload_dim4_heuristics(database);
+        }
+    }
+
+    printf("%-40s %9s %8s %12s %9s\n", "Partitions", "Size (MB)", "Mean h",
+           "Mean nodes", "Seconds");
+    unsigned int best = 0;
+    evaluation best_result;
+    for (unsigned int combination = 1;
+         combination < 1u << num_partitions; combination++)
+    {
+        if ((combination & available) != combination)
+        {
+            continue;
+        }
+        long long size = 0;
+        for (int i = 0; i < num_partitions; i++)
+        {
+            if (combination & (1u << i))
+            {
+                size += sizes[i];
+            }
+        }
+        if (budget_megabytes && size > budget_megabytes * MEGABYTE)
+        {
+            continue;
+        }
+
+        evaluation result;
+        if (!evaluate(partitions, combination, boards, num_boards, &result))
+        {
+            free(boards);
+            return 1;
+        }
+        char names[MAX_NAMES_CHARS];
+        write_names(partitions, combination, names);
+        printf("%-40s %9.1f %8.2f %12.0f %9.3f\n", names,
+               (double) size / MEGABYTE, result.mean_heuristic,
+               result.mean_nodes, result.seconds);
+        fflush(stdout);
+
+        if (!best || result.mean_nodes < best_result.mean_nodes)
+        {
+            best = combination;
+            best_result = result;
+        }
+    }
+    free(boards);
+
+    if (!best)
+    {
+        fprintf(stderr, "No databases fit within the budget.\n");
+        return 1;
+    }
+    char names[MAX_NAMES_CHARS];
+    write_names(partitions, best, names);
+    printf("The fewest nodes are expanded using %s.\n", names);
+    printf("The solvers use the database of every partition declared in %s "
+           "which has been generated.\n", DIM4_PARTITIONS_FILE);
+    return 0;
+}
+
+/*
+ * Reads puzzles from stdin into a new array, saving their number in
+ * num_boards, and returns the array or NULL upon an error.
+ */
+int (*read_boards(long *num_boards))[DIM4_NUM_TILES]
+{
+    int (*boards)[DIM4_NUM_TILES] = NULL;
+    long capacity = 0;
+    *num_boards = 0;
+
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t num_chars = 0;
+    int board[DIM4_NUM_TILES];
+    while ((num_chars = getline(&line, &line_len, stdin)) != -1)
+    {
+        if (!read_dim4_board(line, num_chars, board))
+        {
+            continue;
+        }
+        if (*num_boards == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 256;
+            int (*new_boards)[DIM4_NUM_TILES]
+                = realloc(boards, capacity * sizeof(*boards));
+            if (!new_boards)
+            {
+                free(boards);
+                free(line);
+                return NULL;
+            }
+            boards = new_boards;
+        }
+        memcpy(boards[(*num_boards)++], board, sizeof(board));
+    }
+    free(line);
+
+    // Return an empty array rather than NULL when there are no puzzles.
+    return boards ? boards : malloc(sizeof(*boards));
+}
+
+/*
+ * Solves each of the given boards using the database of the partitions in the
+ * given combination, a bit set of indices into partitions, and saves the
+ * results in result. Returns false upon an error.
+ */
+bool evaluate(const partition partitions[], unsigned int combination,
+              int (*boards)[DIM4_NUM_TILES], long num_boards,
+              evaluation *result)
+{
+    partition chosen[MAX_PARTITIONS];
+    int num_chosen = 0;
+    for (int i = 0; i < MAX_PARTITIONS; i++)
+    {
+        if (combination & (1u << i))
+        {
+            chosen[num_chosen++] = partitions[i];
+        }
+    }
+    pattern_database *database = load_dim4_partitions(chosen, num_chosen);
+    if (!database)
+    {
+        return false;
+    }
+
+    // A single thread without a transposition table, so that the nodes
+    // expanded depend only on the heuristic.
+    dim4_context *context = create_dim4_context(database, 1, 0, true);
+    if (!context)
+    {
+        unload_dim4_heuristics(database);
+        return false;
+    }
+
+    struct timespec start;
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long long heuristics = 0;
+    long long nodes = 0;
+    uint8_t moves[DIM4_MAX_MOVES];
+    bool success = true;
+    for (long i = 0; success && i < num_boards; i++)
+    {
+        heuristics += dim4_heuristic(database, boards[i]);
+        success = dim4_solver(context, boards[i], moves) != -1;
+        nodes += dim4_nodes_expanded(context);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    result->seconds = (finish.tv_sec - start.tv_sec)
+                      + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    result->mean_heuristic = (double) heuristics / num_boards;
+    result->mean_nodes = (double) nodes / num_boards;
+
+    free_dim4_context(context);
+    unload_dim4_heuristics(database);
+    return success;
+}
+
+/*
+ * Writes the names of the partitions in the given combination, a bit set of
+ * indices into partitions, to names separated by '+'.
+ */
+void write_names(const partition partitions[], unsigned int combination,
+                 char names[MAX_NAMES_CHARS])
+{
+    names[0] = '\0';
+    for (int i = 0; i < MAX_PARTITIONS; i++)
+    {
+        if (combination & (1u << i))
+        {
+            if (names[0])
+            {
+                strcat(names, "+");
+            }
+            strcat(names, partitions[i].name);
+        }
+    }
+}
@@ -6,553 +6,450 @@
  * it outputs the optimal number of moves required to solve the puzzle and a
  * list of the tiles to move.
  *
- * The method used is an A* iterative deepening search using a heuristic
- * previously generated by the program generate_dim4_heuristics.c.
- *
- * From the initial puzzle position, we use the heuristic (a minimum number of
- * moves to the solution state) as a limit for a depth first search of the
- * graph generated from successive valid moves of tiles. For each state
- * reached, if the number of moves made plus the heuristic value for that state
- * exceeds the limit, we cut off that search branch. If the search finishes
- * without sucess we increase the limit to be equal to the least of all the
- * costs that were cut off last time round and then start the search again.
- *
- * Since the heuristic never overestimates the actual cost to reach the
- * solution, the first solution we find will be optimal in the total number of
- * moves required.
+ * The solver itself is the same one used by the game, from the library
+ * libfifteen, see dim4_solver.c. This program reads and writes puzzles and,
+ * in batch mode, shares them out between threads each with its own solver
+ * context.
  */
 
 #define _GNU_SOURCE
 
-#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "dim4.h"
+#include "dim4_solver.h"
+
+// Enough characters for a line of output, a solution will have at most 80
+// moves.
+#define MAX_OUTPUT_CHARS 256
 
-// Minimum number of characters for a line of text to be a valid puzzle.
-#define MINIMUM_CHARS 37
+// In batch mode, the number of puzzles per thread which may be read ahead of
+// the earliest puzzle not yet printed.
+#define BATCH_WINDOW_PER_THREAD 64
 
-// Encapsulate the current state of the board, including the moves made since
-// initialization, with a struct node.
+// The number of bytes in a megabyte, the unit of the transposition table size.
+#define MEGABYTE (1024 * 1024)
+
+// A puzzle read in batch mode. Once solved by one of the threads its output
+// waits here until the puzzles before it have been printed.
 typedef struct
 {
     int board[DIM4_NUM_TILES];
-    int empty_index;
-    int heuristic;
-    int num_moves;
-    // A solution will have at most 80 moves.
-    // http://www.iro.umontreal.ca/~gendron/Pisa/References/BB/Brungger99.pdf
-    int moves[80];
+    bool valid;
+    bool done;
+    char output[MAX_OUTPUT_CHARS];
 }
-node;
-
-// A global to track when the puzzle becomes solved to help back out of the
-// recursive search.
-static bool solved;
-
-/*
- * Given a board of tiles and an array of heuristic values, calls successive
- * heuristic-guided depth-first searches until a solution is found to the
- * puzzle. Prints the solution and returns true. Otherwise returns false.
- */
-bool dim4_solver(uint8_t *dim4_array, int board[DIM4_NUM_TILES]);
-
-/*
- * Starting from the given node, and using heuristics provided by dim4_array,
- * performs a depth first search cutting off search branches when the
- * estimated costs exceed the bound. Once complete, returns the least bound
- * that could be used for another such search at a greater depth. If at any
- * point the search reaches the goal state, the search terminates having saved
- * the solution path in the node n.
- */
-int depth_first_search(node *n, int bound, uint8_t *dim4_array);
+batch_slot;
 
-/*
- * Loads heuristic values from disk into an array and returns a pointer to that
- * array.
- */
-uint8_t *load_dim4_heuristics(void);
-
-/*
- * For a given board of tiles, retrieves the heuristic for that board from the
- * array of heuristic values.
- */
-int get_heurisitic(uint8_t *dim4_array, int board[DIM4_NUM_TILES]);
-
-/*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
- */
-int arr_index(int board[DIM4_NUM_TILES], tile_pattern pattern, bool reflected);
+// The state shared by the threads of batch mode. Puzzle k is held in
+// slots[k % window], a reorder buffer which keeps the output in input order.
+typedef struct
+{
+    const pattern_database *database;
+    // The size in bytes of each thread's transposition table, or 0.
+    size_t table_size;
+    // Whether moves are made in order of their heuristic, see order_moves.
+    bool ordered;
+    batch_slot *slots;
+    int window;
+    // Guards all of the following. Threads wait on readable for puzzles to
+    // be read, and the reader waits on writable for slots to be printed.
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    long num_read;
+    long num_taken;
+    long num_printed;
+    long num_solved;
+    bool end_of_input;
+    bool failed;
+}
+batch;
 
 /*
- * Returns true if and only if the puzzle represented by board is solved.
+ * Writes the line of output for a solution of the given number of moves,
+ * optionally with the moves themselves, to the string output.
  */
-bool is_solved(int board[DIM4_NUM_TILES]);
+void write_solution(int num_moves, const uint8_t moves[],
+                    char output[MAX_OUTPUT_CHARS]);
 
 /*
- * Swaps the contents of array[i] and array[j], increments a swap counter.
+ * Reads puzzles from stdin and solves them one after another, each using
+ * num_threads threads, with a transposition table of table_size bytes for
+ * each thread unless table_size is 0, making moves in order of their
+ * heuristic if ordered. Returns the number of puzzles solved or -1 upon an
+ * error.
  */
-void swap(int array[], int i, int j, int *swap_count);
+long solve_in_sequence(const pattern_database *database, int num_threads,
+                       size_t table_size, bool ordered);
 
 /*
- * Quicksorts an array between indices low and high inclusive. Also counts the
- * number of swaps made whilst sorting.
+ * Reads puzzles from stdin and solves num_threads of them at a time, with a
+ * transposition table of table_size bytes for each thread unless table_size
+ * is 0 and making moves in order of their heuristic if ordered, printing the
+ * solutions in the order the puzzles were read. Returns the number of puzzles
+ * solved or -1 upon an error.
  */
-void quicksort(int array[], int low, int high, int *swap_count);
+long solve_in_batch(const pattern_database *database, int num_threads,
+                    size_t table_size, bool ordered);
 
 /*
- * Returns true if array represents a solvable puzzle, returns false otherwise.
+ * The work of a single thread in batch mode. Repeatedly takes the next puzzle
+ * read, solves it and prints any solutions which are next in order, until
+ * the input is exhausted.
  */
-bool is_solvable(int array[]);
+void *solve_batch_puzzles(void *arg);
 
 
-int main(void)
+int main(int argc, char *argv[])
 {
-    // Load the heuristic values into an array.
-    uint8_t *dim4_array = load_dim4_heuristics();
-    if (!dim4_array)
+    // The number of threads used to search for each solution or, in batch
+    // mode, the number of puzzles solved at once.
+    int num_threads = 1;
+    bool batch_mode = false;
+    // The total size of the threads' transposition tables in megabytes, none
+    // by default.
+    long table_megabytes = 0;
+    // Moves are made in order of their heuristic unless -u is given.
+    bool ordered = true;
+    // The end of the number parsed from an option's argument.
+    char *end;
+    int opt;
+    while ((opt = getopt(argc, argv, "bj:t:u")) != -1)
     {
-        return 1;
-    }
-
-    // Continuously read lines from stdin.
-    char *line = NULL;
-    size_t line_len = 0;
-    ssize_t num_chars = 0;
-    char *endptr = NULL;
-    int board[DIM4_NUM_TILES] = {0};
-
-    while ((num_chars = getline(&line, &line_len, stdin)) != -1)
-    {
-        // Remove trailing newlines.
-        while (line[num_chars - 1] == '\r' || line[num_chars - 1] == '\n')
-        {
-            line[num_chars] = 0;
-            num_chars--;
-        }
-
-        // Ensure we have a minimum number of characters that we might have a
-        // valid puzzle.
-        if (num_chars >= MINIMUM_CHARS)
+        switch (opt)
         {
-            char *p = line;
-            int i = 0;
-            while (true)
-            {
-                board[i] = (int) strtol(p, &endptr, 10);
-                if ((board[i] < 0 || board[i] > 15) || (p == endptr)
-                    || (i >= DIM4_NUM_TILES))
+            case 'b':
+                batch_mode = true;
+                break;
+            case 'u':
+                ordered = false;
+                break;
+            case 't':
+                table_megabytes = strtol(optarg, &end, 10);
+                if (end == optarg || *end || table_megabytes < 0)
                 {
-                    break;
+                    fprintf(stderr, "%s: -t takes a whole number of megabytes "
+                            "for the transposition tables, 0 for none.\n",
+                            argv[0]);
+                    return 1;
                 }
-                p = endptr;
-                i++;
-            }
-            // Verify we have a solvable puzzle, then call the solver.
-            if (i == DIM4_NUM_TILES && is_solvable(board))
-            {
-                if (!dim4_solver(dim4_array, board))
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                if (num_threads >= 1)
                 {
                     break;
                 }
-            }
+                // Fall through.
+            default:
+                fprintf(stderr, "Usage: %s [-j threads] [-b] [-t megabytes] "
+                        "[-u]\n", argv[0]);
+                return 1;
         }
     }
 
-    free(dim4_array);
-    if (line)
+    // Load the database of heuristic values, or without one use the walking
+    // distance which is slower but still finds optimal solutions.
+    pattern_database *loaded = load_dim4_heuristics();
+    const pattern_database *database = loaded;
+    if (!database)
     {
-        free(line);
+        fprintf(stderr, "Could not load the heuristics declared in %s, "
+                "using the walking distance instead.\n",
+                DIM4_PARTITIONS_FILE);
+        database = build_dim4_walking_distance();
     }
 
-    return 0;
-}
+    struct timespec start;
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-/*
- * Given a board of tiles and an array of heuristic values, calls successive
- * heuristic-guided depth-first searches until a solution is found to the
- * puzzle. Prints the solution and returns true. Otherwise returns false.
- */
-bool dim4_solver(uint8_t *dim4_array, int board[DIM4_NUM_TILES])
-{
-    // Setup a root node.
-    node *root = malloc(sizeof(node));
-    if (!root)
+    // The memory for transposition tables is shared equally by the threads.
+    size_t table_size = table_megabytes * MEGABYTE / num_threads;
+
+    long num_solved;
+    if (batch_mode)
     {
-        return false;
+        num_solved = solve_in_batch(database, num_threads, table_size,
+                                    ordered);
     }
-    for (int i = 0; i < DIM4_NUM_TILES; i++)
-    {
-        if (board[i] == 0)
-        {
-            root->empty_index = i;
-        }
-        root->board[i] = board[i];
-    }
-    root->num_moves = 0;
-    root->heuristic = get_heurisitic(dim4_array, root->board);
-
-    // Use the heuristic as the initial bound for successive A* depth-first
-    // searches.
-    solved = false;
-    int bound = root->heuristic;
-    while (!solved)
+    else
     {
-        bound = depth_first_search(root, bound, dim4_array);
-        if (bound == INT_MAX)
-        {
-            return false;
-        }
+        num_solved = solve_in_sequence(database, num_threads, table_size,
+                                       ordered);
     }
 
-    // Print the number of moves and optionally the moves themselves required
-    // to solve the puzzle.
-    bool print_moves = true;
-    if (is_solved(root->board))
+    // In batch mode report the throughput.
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double seconds = (finish.tv_sec - start.tv_sec)
+                     + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    if (batch_mode && num_solved != -1)
     {
-        if (print_moves)
-        {
-            printf("%i moves: ", root->num_moves);
-            for (int i = 0; i < root->num_moves; i++)
-            {
-                printf("%i ", root->moves[i]);
-            }
-            printf("\n");
-        }
-        else
-        {
-            printf("%i\n", root->num_moves);
-        }
+        fprintf(stderr, "Solved %li puzzles in %.3f seconds, %.2f puzzles "
+                "per second.\n", num_solved, seconds,
+                seconds > 0 ? num_solved / seconds : 0);
     }
-    else
+
+    if (loaded)
     {
-        printf("Error!\n");
-        return false;
+        unload_dim4_heuristics(loaded);
     }
 
-    free(root);
-
-    return true;
+    return num_solved == -1 ? 1 : 0;
 }
 
 /*
- * Starting from the given node, and using heuristics provided by dim4_array,
- * performs a depth first search cutting off search branches when the
- * estimated costs exceed the bound. Once complete, returns the least bound
- * that could be used for another such search at a greater depth. If at any
- * point the search reaches the goal state, the search terminates having saved
- * the solution path in the node n.
+ * Reads puzzles from stdin and solves them one after another, each using
+ * num_threads threads, with a transposition table of table_size bytes for
+ * each thread unless table_size is 0, making moves in order of their
+ * heuristic if ordered. Returns the number of puzzles solved or -1 upon an
+ * error.
  */
-int depth_first_search(node *n, int bound, uint8_t *dim4_array)
+long solve_in_sequence(const pattern_database *database, int num_threads,
+                       size_t table_size, bool ordered)
 {
-    // Check for solved state.
-    if (n->heuristic == 0)
+    // The context, and so its tables, is kept from one puzzle to the next.
+    dim4_context *context = create_dim4_context(database, num_threads,
+                                                table_size, ordered);
+    if (!context)
     {
-        solved = true;
-        return 0;
+        return -1;
     }
 
-    // Look for a new bound to return.
-    int new_bound = INT_MAX;
+    // Continuously read lines from stdin.
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t num_chars = 0;
+    int board[DIM4_NUM_TILES] = {0};
+    uint8_t moves[DIM4_MAX_MOVES];
+    char output[MAX_OUTPUT_CHARS];
+    long num_solved = 0;
 
-    // For each neighbour node.
-    for (int i = 0; i < 4; i++)
+    while ((num_chars = getline(&line, &line_len, stdin)) != -1)
     {
-        int move_index = valid_moves[n->empty_index][i];
-
-        // If we have a valid move.
-        if (move_index != -1)
+        // Call the solver for each valid puzzle.
+        if (read_dim4_board(line, num_chars, board))
         {
-            int tile = n->board[move_index];
-
-            if (tile != n->moves[n->num_moves - 1])
+            int num_moves = dim4_solver(context, board, moves);
+            if (num_moves == -1)
             {
-                int old_empty_index = n->empty_index;
-
-                // Track the old heuristic value.
-                int old_heuristic = n->heuristic;
-
-                // Make the move by updating the node n.
-                n->board[n->empty_index] = tile;
-                n->board[move_index] = 0;
-                n->empty_index = move_index;
-
-                // Get the new heuristic after the move.
-                n->heuristic = get_heurisitic(dim4_array, n->board);
-
-                // Add the move to the moves list.
-                n->moves[n->num_moves] = tile;
-                n->num_moves += 1;
-
-                // The new bound.
-                int b = 1 + n->heuristic;
-
-                if (b <= bound)
-                {
-                    // Search deeper.
-                    b = 1 + depth_first_search(n, bound - 1, dim4_array);
-                }
-
-                // The puzzle is solved so back out of recursion.
-                if (solved)
-                {
-                    return b;
-                }
-
-                // Take the minimum of the b as the next bound.
-                if (b < new_bound)
-                {
-                    new_bound = b;
-                }
-
-                // Undo the move in preparation for the next neighbour.
-                n->board[move_index] = tile;
-                n->board[old_empty_index] = 0;
-                n->empty_index = old_empty_index;
-
-                // Restore the node's old heuristic.
-                n->heuristic = old_heuristic;
-
-                // Take the move off the moves list.
-                n->num_moves -= 1;
-                n->moves[n->num_moves] = 0;
-
+                num_solved = -1;
+                break;
             }
+            write_solution(num_moves, moves, output);
+            fputs(output, stdout);
+            num_solved++;
         }
     }
-    return new_bound;
+
+    free_dim4_context(context);
+    if (line)
+    {
+        free(line);
+    }
+    return num_solved;
 }
 
 /*
- * Loads heuristic values from disk into an array and returns a pointer to that
- * array.
+ * Reads puzzles from stdin and solves num_threads of them at a time, with a
+ * transposition table of table_size bytes for each thread unless table_size
+ * is 0 and making moves in order of their heuristic if ordered, printing the
+ * solutions in the order the puzzles were read. Returns the number of puzzles
+ * solved or -1 upon an error.
  */
-uint8_t *load_dim4_heuristics(void)
+long solve_in_batch(const pattern_database *database, int num_threads,
+                    size_t table_size, bool ordered)
 {
-    uint8_t *dim4_array = malloc(TOTAL_STATES);
-    if (!dim4_array)
+    batch b;
+    b.database = database;
+    b.table_size = table_size;
+    b.ordered = ordered;
+    b.window = num_threads * BATCH_WINDOW_PER_THREAD;
+    b.slots = calloc(b.window, sizeof(batch_slot));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    if (!b.slots || !threads)
     {
-        return NULL;
+        free(b.slots);
+        free(threads);
+        return -1;
     }
-
-    // Load heuristics data.
-    FILE *fp = fopen(DIM4_HEURISTICS_FILE, "rb");
-    if (!fp)
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.readable, NULL);
+    pthread_cond_init(&b.writable, NULL);
+    b.num_read = 0;
+    b.num_taken = 0;
+    b.num_printed = 0;
+    b.num_solved = 0;
+    b.end_of_input = false;
+    b.failed = false;
+
+    int num_started = 0;
+    for (int i = 0; i < num_threads; i++)
     {
-        if (dim4_array)
+        if (pthread_create(&threads[num_started], NULL, solve_batch_puzzles,
+                           &b) == 0)
         {
-            free(dim4_array);
+            num_started++;
         }
-        return NULL;
     }
 
-    if (fread(dim4_array, TOTAL_STATES, 1, fp) != 1)
+    // Read lines into the reorder buffer, waiting whenever it is full.
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t num_chars = 0;
+    while (num_started > 0
+           && (num_chars = getline(&line, &line_len, stdin)) != -1)
     {
-        if (dim4_array)
+        pthread_mutex_lock(&b.lock);
+        while (b.num_read - b.num_printed == b.window && !b.failed)
         {
-            free(dim4_array);
+            pthread_cond_wait(&b.writable, &b.lock);
         }
-        fclose(fp);
-        return NULL;
+        bool failed = b.failed;
+        pthread_mutex_unlock(&b.lock);
+        if (failed)
+        {
+            break;
+        }
+
+        // The slot is not seen by the threads until num_read is increased.
+        batch_slot *slot = &b.slots[b.num_read % b.window];
+        slot->valid = read_dim4_board(line, num_chars, slot->board);
+        slot->done = false;
+
+        pthread_mutex_lock(&b.lock);
+        b.num_read++;
+        pthread_cond_signal(&b.readable);
+        pthread_mutex_unlock(&b.lock);
     }
-    fclose(fp);
-    return dim4_array;
-}
 
-/*
- * For a given board of tiles, retrieves a heuristic for that board from the
- * array of heuristic values.
- */
-int get_heurisitic(uint8_t *dim4_array, int board[DIM4_NUM_TILES])
-{
-    int index;
-    int heuristic = 0;
-    int reflected_heuristic = 0;
-    // Sum the heuristic values for each pattern.
-    for (int i = 0; i < NUM_PATTERNS; i++)
+    pthread_mutex_lock(&b.lock);
+    b.end_of_input = true;
+    pthread_cond_broadcast(&b.readable);
+    pthread_mutex_unlock(&b.lock);
+    for (int i = 0; i < num_started; i++)
     {
-        // First get the normal heuristic.
-        index = arr_index(board, patterns[i], false);
-        heuristic += dim4_array[index + patterns[i].array_offset];
-
-        // Now calculate the heuristic for the board reflected about the main
-        // diagonal.
-        index = arr_index(board, patterns[i], true);
-        reflected_heuristic += dim4_array[index + patterns[i].array_offset];
+        pthread_join(threads[i], NULL);
     }
 
-    // Take the maximum of the two heuristics.
-    if (heuristic < reflected_heuristic)
+    long num_solved = b.failed || num_started == 0 ? -1 : b.num_solved;
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.readable);
+    pthread_cond_destroy(&b.writable);
+    free(b.slots);
+    free(threads);
+    if (line)
     {
-        heuristic = reflected_heuristic;
+        free(line);
     }
-
-    return heuristic;
+    return num_solved;
 }
 
 /*
- * For a given board of tiles and a tile pattern returns a unique index based
- * on where the tiles in the pattern are on the board. The index will be
- * greater than or equal to 0 and less than 16^n, where n is the number of
- * tiles in the pattern.
+ * The work of a single thread in batch mode. Repeatedly takes the next puzzle
+ * read, solves it and prints any solutions which are next in order, until
+ * the input is exhausted.
  */
-int arr_index(int board[DIM4_NUM_TILES], tile_pattern pattern, bool reflected)
+void *solve_batch_puzzles(void *arg)
 {
-    int index = 0;
-    int k = 1;
+    batch *b = arg;
+    uint8_t moves[DIM4_MAX_MOVES];
+
+    // Each thread has its own context, and so its own table, kept from one
+    // puzzle to the next.
+    dim4_context *context = create_dim4_context(b->database, 1,
+                                                b->table_size, b->ordered);
+    if (!context)
+    {
+        pthread_mutex_lock(&b->lock);
+        b->failed = true;
+        pthread_cond_broadcast(&b->writable);
+        pthread_cond_broadcast(&b->readable);
+        pthread_mutex_unlock(&b->lock);
+        return NULL;
+    }
 
-    if (reflected)
+    pthread_mutex_lock(&b->lock);
+    while (true)
     {
-        for (int i = 0; i < pattern.num_tiles; i++)
+        while (b->num_taken == b->num_read && !b->end_of_input && !b->failed)
         {
-            for (int j = 0; j < DIM4_NUM_TILES; j++)
-            {
-                // If we are computed a heuristic for the board reflected along
-                // its main diagonal we use the corresponding reflected patten
-                // and must compute the location of the tile under the
-                // reflection to get the index to lookup.
-                if (pattern.reflected_tiles[i] == board[j])
-                {
-                    index += (DIM4 * j - ((DIM4_NUM_TILES - 1) * (j / DIM4))) * k;
-                    k *= DIM4_NUM_TILES;
-                    break;
-                }
-            }
+            pthread_cond_wait(&b->readable, &b->lock);
         }
-    }
-    else
-    {
-        for (int i = 0; i < pattern.num_tiles; i++)
+        if (b->num_taken == b->num_read || b->failed)
         {
-            for (int j = 0; j < DIM4_NUM_TILES; j++)
+            break;
+        }
+        batch_slot *slot = &b->slots[b->num_taken % b->window];
+        b->num_taken++;
+        pthread_mutex_unlock(&b->lock);
+
+        // Solve the puzzle, invalid lines produce no output.
+        bool success = true;
+        slot->output[0] = 0;
+        if (slot->valid)
+        {
+            int num_moves = dim4_solver(context, slot->board, moves);
+            success = num_moves != -1;
+            if (success)
             {
-                if (pattern.tiles[i] == board[j])
-                {
-                    index += j * k;
-                    k *= DIM4_NUM_TILES;
-                    break;
-                }
+                write_solution(num_moves, moves, slot->output);
             }
         }
-    }
-
-    return index;
-}
 
-/*
- * Returns true if and only if puzzle is solved.
- */
-bool is_solved(int board[DIM4_NUM_TILES])
-{
-    // Check empty tile in correct place.
-    if (board[DIM4_NUM_TILES - 1] != 0)
-    {
-        return false;
-    }
-
-    // Check the other tiles.
-    for (int i = 0; i < DIM4_NUM_TILES - 1; i++)
-    {
-        // Check if tiles match the solved pattern (excluding the empty).
-        if (board[i] != i + 1)
+        pthread_mutex_lock(&b->lock);
+        slot->done = true;
+        if (!success)
         {
-            return false;
+            b->failed = true;
+            pthread_cond_broadcast(&b->writable);
+            pthread_cond_broadcast(&b->readable);
+            break;
         }
-    }
-
-    return true;
-}
-
-/*
- * Swaps the contents of array[i] and array[j], increments a swap counter.
- */
-void swap(int array[], int i, int j, int *swap_count)
-{
-    if (array[i] == array[j])
-    {
-        return;
-    }
-    *swap_count += 1;
-    int temp = array[i];
-    array[i] = array[j];
-    array[j] = temp;
-    return;
-}
-
-/*
- * Quicksorts an array between indices low and high inclusive. Also counts the
- * number of swaps made whilst sorting.
- */
-void quicksort(int array[], int low, int high, int *swap_count)
-{
-    if (low < high)
-    {
-        // Using array[high] as a pivot, partition the array and get the index
-        // of where the pivot should go.
-
-        // Track the new index where the pivot value should go once finished
-        int pivot_index = low;
-
-        // Loop through the array up to but not including pivot array[high].
-        for (int i = low; i < high; i++)
+        if (slot->valid)
         {
-            // Swap values as necessary comparing against the pivot value.
-            if (array[i] <= array[high])
-            {
-                swap(array, i, pivot_index, swap_count);
-                // If a swap is done, increment the new index for the pivot.
-                pivot_index++;
-            }
+            b->num_solved++;
         }
 
-        // Now swap the pivot currently at array[high] into the correct index.
-        swap(array, pivot_index, high, swap_count);
-
-        // Recursively call on sub-arrays below and above pivot index.
-        quicksort(array, low, pivot_index - 1, swap_count);
-        quicksort(array, pivot_index + 1, high, swap_count);
+        // Print the solutions which are now next in order.
+        while (b->num_printed < b->num_read
+               && b->slots[b->num_printed % b->window].done)
+        {
+            fputs(b->slots[b->num_printed % b->window].output, stdout);
+            b->num_printed++;
+            pthread_cond_signal(&b->writable);
+        }
     }
-    return;
+    pthread_mutex_unlock(&b->lock);
+    free_dim4_context(context);
+    return NULL;
 }
 
 /*
- * Returns true if array represents a solvable puzzle, returns false otherwise.
+ * Writes the line of output for a solution of the given number of moves,
+ * optionally with the moves themselves, to the string output.
  */
-bool is_solvable(int board[])
+void write_solution(int num_moves, const uint8_t moves[],
+                    char output[MAX_OUTPUT_CHARS])
 {
-    // To ensure a valid solvable puzzle, the parity of the permutation of the
-    // tiles 1 to 16 (with the empty tile being 16) plus the parity of the
-    // taxicab distance (number of rows plus number of columns) of the empty
-    // tile from the lower right corner, must be even. (This is an invariant
-    // for the puzzle moves.)
-
-    // Find the index of the empty tile.
-    int i;
-    for (i = 0; i < DIM4_NUM_TILES; i++)
+    bool print_moves = true;
+    if (print_moves)
     {
-        if (board[i] == 0)
+        int len = sprintf(output, "%i moves: ", num_moves);
+        for (int i = 0; i < num_moves; i++)
         {
-            break;
+            len += sprintf(output + len, "%i ", moves[i]);
         }
+        sprintf(output + len, "\n");
+    }
+    else
+    {
+        sprintf(output, "%i\n", num_moves);
     }
-
-    // Copy the board and change the empty tile to a 16.
-    int array[DIM4_NUM_TILES];
-    memcpy(array, board, sizeof (int) * DIM4_NUM_TILES);
-    array[i] = DIM4_NUM_TILES;
-
-    // Quicksort the array and count the swaps.
-    int swap_count = 0;
-    quicksort(array, 0, DIM4_NUM_TILES - 1, &swap_count);
-    // Determine taxicab distance of empty tile.
-    int taxicab_dist = DIM4 - 1 - (i % DIM4) + DIM4 - 1 - (i / DIM4);
-
-    return (swap_count + taxicab_dist) % 2 == 0;
 }
-